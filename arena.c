@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "header.h"
+#include "arena.h"
+
+// blocks of the arena, everything after the current block is unused
+static ARENA_BLOCK *arena_head = NULL;
+static ARENA_BLOCK *arena_current = NULL;
+
+/**
+ * Přidá na konec areny nový blok.
+ *
+ * @param size - požadovaná velikost dat
+ *
+ * @return nový blok, NULL - nedostatek paměti
+ */
+static ARENA_BLOCK *arena_add_block(size_t size) {
+    size_t block_size = size + ARENA_ALIGNMENT > ARENA_BLOCK_SIZE ? size + ARENA_ALIGNMENT : ARENA_BLOCK_SIZE;
+    ARENA_BLOCK *block = malloc(sizeof(ARENA_BLOCK) + block_size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = block_size;
+    block->used = 0;
+
+    if (arena_head == NULL) {
+        arena_head = block;
+    } else {
+        ARENA_BLOCK *last = arena_current;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+        last->next = block;
+    }
+    return block;
+}
+
+/**
+ * Alokuje vynulovanou paměť pro dočasná data příkazu. Paměť se neuvolňuje jednotlivě, uvolní ji
+ * až arena_release po skončení příkazu (viz commands), bloky areny se přitom znovu použijí.
+ *
+ * @param size - velikost v bajtech
+ *
+ * @return paměť zarovnaná na ARENA_ALIGNMENT, NULL - nedostatek paměti
+ */
+void *arena_alloc(size_t size) {
+    if (arena_current == NULL) {
+        arena_current = arena_head != NULL ? arena_head : arena_add_block(size);
+        if (arena_current == NULL) {
+            return NULL;
+        }
+        arena_current->used = 0;
+    }
+
+    while (true) {
+        uintptr_t start = (uintptr_t) (arena_current->data + arena_current->used);
+        size_t padding = (ARENA_ALIGNMENT - start % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+        if (padding + size <= arena_current->size - arena_current->used) {
+            void *memory = arena_current->data + arena_current->used + padding;
+            arena_current->used += padding + size;
+            return memset(memory, 0, size);
+        }
+
+        // the following blocks are free, a new one is added only when none of them is left
+        ARENA_BLOCK *next = arena_current->next != NULL ? arena_current->next : arena_add_block(size);
+        if (next == NULL) {
+            return NULL;
+        }
+        next->used = 0;
+        arena_current = next;
+    }
+}
+
+/**
+ * Vrátí aktuální stav areny, arena_release k němu uvolní vše, co bylo alokováno později.
+ *
+ * @return stav areny
+ */
+ARENA_MARK arena_mark(void) {
+    ARENA_MARK mark;
+    mark.block = arena_current;
+    mark.used = arena_current != NULL ? arena_current->used : 0;
+    return mark;
+}
+
+/**
+ * Uvolní všechny alokace od daného stavu areny. Vnořené příkazy (load) tak uvolní jen svá data.
+ *
+ * @param mark - stav areny z arena_mark
+ */
+void arena_release(ARENA_MARK mark) {
+    arena_current = mark.block;
+    if (arena_current != NULL) {
+        arena_current->used = mark.used;
+    }
+}
+
+/**
+ * Vrátí všechny bloky areny systému.
+ */
+void arena_free(void) {
+    while (arena_head != NULL) {
+        ARENA_BLOCK *next = arena_head->next;
+        free(arena_head);
+        arena_head = next;
+    }
+    arena_current = NULL;
+}
@@ -0,0 +1,11 @@
+#ifndef ZOS_ARENA_H
+#define ZOS_ARENA_H
+
+#include "header.h"
+
+void *arena_alloc(size_t size);
+ARENA_MARK arena_mark(void);
+void arena_release(ARENA_MARK mark);
+void arena_free(void);
+
+#endif //ZOS_ARENA_H
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "header.h"
+#include "cache.h"
+#include "directory.h"
+
+/**
+ * Vrátí index slotu cache pro dvojici (rodičovský i-node, jméno).
+ *
+ * @param parent_id - id rodičovského i-nodu
+ * @param name - jméno položky
+ *
+ * @return index slotu
+ */
+static int32_t dentry_slot(int32_t parent_id, char *name) {
+    return (directory_hash(name) ^ ((uint32_t) parent_id * 2654435761u)) % DENTRY_CACHE_SIZE;
+}
+
+/**
+ * Inicializuje cache adresářových položek.
+ *
+ * @param inode_count - počet i-nodů file systému
+ *
+ * @return struktura cache
+ */
+DENTRY_CACHE *cache_init(int32_t inode_count) {
+    DENTRY_CACHE *cache = calloc(1, sizeof(DENTRY_CACHE));
+
+    // all slots are empty
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        cache->dentries[i].node_id = -1;
+    }
+
+    cache->directory_count = inode_count;
+    cache->directories = calloc(inode_count, sizeof(DIRECTORY_ITEMS *));
+
+    return cache;
+}
+
+/**
+ * Uvolní cache včetně všech načtených adresářů.
+ *
+ * @param cache - struktura cache
+ */
+void cache_free(DENTRY_CACHE *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < cache->directory_count; i++) {
+        if (cache->directories[i] != NULL) {
+            free_directory_items(cache->directories[i]);
+        }
+    }
+
+    free(cache->directories);
+    free(cache);
+}
+
+/**
+ * Vrátí obsah adresáře z cache, případně ho načte ze souboru FS. Vrácená struktura patří cache,
+ * volající ji nesmí měnit ani uvolňovat.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ *
+ * @return obsah adresáře
+ */
+DIRECTORY_ITEMS *cache_get_directory(FS *fs, PSEUDO_INODE *inode) {
+    DENTRY_CACHE *cache = fs->cache;
+
+    if (cache->directories[inode->node_id] == NULL) {
+        cache->directories[inode->node_id] = read_directory_items_from_file(fs, inode);
+    }
+
+    return cache->directories[inode->node_id];
+}
+
+/**
+ * Najde položku se zadaným jménem v adresáři.
+ *
+ * @param fs - struktura file systému
+ * @param parent - i-node adresáře, ve kterém hledáme
+ * @param name - jméno položky
+ *
+ * @return  i-node položky
+ *          NULL, pokud adresář položku neobsahuje
+ */
+PSEUDO_INODE *cache_lookup(FS *fs, PSEUDO_INODE *parent, char *name) {
+    DENTRY_CACHE *cache = fs->cache;
+    DENTRY *dentry = &cache->dentries[dentry_slot(parent->node_id, name)];
+
+    if (dentry->node_id != -1 && dentry->parent_id == parent->node_id &&
+        strncmp(dentry->name, name, MAX_FILENAME_LENGTH) == 0) {
+        cache->hits++;
+        return &fs->inodes->data[dentry->node_id];
+    }
+    cache->misses++;
+
+    // hashed lookup in the directory itself, the result is remembered
+    int32_t node_id = directory_lookup(fs, parent, name);
+    if (node_id != -1) {
+        dentry->parent_id = parent->node_id;
+        dentry->node_id = node_id;
+        strncpy(dentry->name, name, MAX_FILENAME_LENGTH);
+        return &fs->inodes->data[node_id];
+    }
+
+    return NULL;
+}
+
+/**
+ * Zneplatní obsah adresáře v cache a všechny položky, jejichž rodičem je tento adresář.
+ * Volá se při smazání adresáře.
+ *
+ * @param fs - struktura file systému
+ * @param node_id - id i-nodu adresáře
+ */
+void cache_invalidate_directory(FS *fs, int32_t node_id) {
+    DENTRY_CACHE *cache = fs->cache;
+
+    if (node_id < 0 || node_id >= cache->directory_count) {
+        return;
+    }
+
+    if (cache->directories[node_id] != NULL) {
+        free_directory_items(cache->directories[node_id]);
+        cache->directories[node_id] = NULL;
+    }
+
+    for (int i = 0; i < DENTRY_CACHE_SIZE; i++) {
+        if (cache->dentries[i].parent_id == node_id) {
+            cache->dentries[i].node_id = -1;
+        }
+    }
+}
+
+/**
+ * Zneplatní jednu položku adresáře v cache a načtený obsah adresáře. Volá se při vložení
+ * nebo odebrání položky.
+ *
+ * @param fs - struktura file systému
+ * @param parent_id - id i-nodu adresáře
+ * @param name - jméno položky
+ */
+void cache_invalidate_entry(FS *fs, int32_t parent_id, char *name) {
+    DENTRY_CACHE *cache = fs->cache;
+
+    if (parent_id < 0 || parent_id >= cache->directory_count) {
+        return;
+    }
+
+    if (cache->directories[parent_id] != NULL) {
+        free_directory_items(cache->directories[parent_id]);
+        cache->directories[parent_id] = NULL;
+    }
+
+    DENTRY *dentry = &cache->dentries[dentry_slot(parent_id, name)];
+    if (dentry->parent_id == parent_id && strncmp(dentry->name, name, MAX_FILENAME_LENGTH) == 0) {
+        dentry->node_id = -1;
+    }
+}
+
+/**
+ * Vypíše statistiky cache.
+ *
+ * @param cache - struktura cache
+ */
+void print_cache(DENTRY_CACHE *cache) {
+    printf("--- DENTRY CACHE ---\n");
+    printf("Hits: %lld\n", (long long) cache->hits);
+    printf("Misses: %lld\n", (long long) cache->misses);
+    printf("\n");
+}
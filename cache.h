@@ -0,0 +1,16 @@
+#ifndef ZOS_CACHE_H
+#define ZOS_CACHE_H
+
+#include "header.h"
+
+DENTRY_CACHE *cache_init(int32_t inode_count);
+void cache_free(DENTRY_CACHE *cache);
+
+DIRECTORY_ITEMS *cache_get_directory(FS *fs, PSEUDO_INODE *inode);
+PSEUDO_INODE *cache_lookup(FS *fs, PSEUDO_INODE *parent, char *name);
+void cache_invalidate_directory(FS *fs, int32_t node_id);
+void cache_invalidate_entry(FS *fs, int32_t parent_id, char *name);
+
+void print_cache(DENTRY_CACHE *cache);
+
+#endif //ZOS_CACHE_H
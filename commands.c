@@ -5,27 +5,40 @@
 #include <dirent.h>
 #include <errno.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <unistd.h>
 #include "header.h"
 #include "commands.h"
 #include "inodes.h"
 #include "fs.h"
 #include "directory.h"
+#include "io.h"
+#include "cache.h"
+#include "stats.h"
+#include "trace.h"
+#include "arena.h"
+
+int isRunning = 1;      // 1 = yes
+int isInteractive = 1;  // 1 = prompt and FS dump for a user at the terminal
 
 /**
  * Přesune soubor z fyzického disku do FS.
  *
  * @param fs - struktura file systému
  * @param token parametry příkazu
+ *
+ * @return  true - soubor byl nahrán
+ *          false - jinak
  */
-void file_in(FS *fs, char *token) {
-    char source_filename[MAX_FILENAME_LENGTH];
+bool file_in(FS *fs, char *token) {
+    char source_filename[PATH_MAX];
     PSEUDO_INODE *destination_inode = NULL;
 
     // get first argument - source_filename file
     token = strtok(NULL, SPLIT_ARGS_CHAR);
     if (token == NULL || strlen(token) < 1) {
         printf("FILE NOT FOUND\n");
-        return;
+        return false;
     }
     if (token[strlen(token) - 1] == '\n') {
         token[strlen(token) - 1] = '\0';
@@ -36,8 +49,10 @@ void file_in(FS *fs, char *token) {
     FILE *source_file = fopen(source_filename, "rb");
     if (source_file == NULL) {
         printf("FILE NOT FOUND\n");
-        return;
+        return false;
     }
+    // the source is streamed, host reads go in chunks of IO_CHUNK_SIZE
+    setvbuf(source_file, NULL, _IOFBF, IO_CHUNK_SIZE);
 
     // get second argument
     token = strtok(NULL, SPLIT_ARGS_CHAR);
@@ -50,7 +65,7 @@ void file_in(FS *fs, char *token) {
     // destination node found
     if (destination_inode == NULL) {
         fclose(source_file);
-        return;
+        return false;
     }
 
     // get filename
@@ -59,9 +74,60 @@ void file_in(FS *fs, char *token) {
     // create file in FS
     bool result = create_file_in_FS(fs, source_file, filename, destination_inode);
 
-    // write changes to FS file
-    write_inodes_to_file(fs);
-    write_bitmap_to_file(fs);
+    // print result
+    if (result == true) {
+        printf("OK\n");
+    } else {
+        printf("NOK\n");
+    }
+
+    return result;
+}
+
+/**
+ * Připojí obsah souboru z fyzického disku na konec souboru ve FS. Poslední neúplný cluster
+ * se doplní na místě, nové clustery se alokují jen pro připojená data.
+ *
+ * @param fs - struktura file systému
+ * @param token parametry příkazu
+ *
+ * @return  true - data byla připojena
+ *          false - jinak
+ */
+bool append_file(FS *fs, char *token) {
+    // get first argument - source file on the disk
+    token = strtok(NULL, SPLIT_ARGS_CHAR);
+    if (token == NULL || strlen(token) < 1) {
+        printf("FILE NOT FOUND\n");
+        return false;
+    }
+    token[strcspn(token, "\n")] = '\0';
+
+    FILE *source_file = fopen(token, "rb");
+    if (source_file == NULL) {
+        printf("FILE NOT FOUND\n");
+        return false;
+    }
+
+    // get second argument - file in FS, a symbolic link appends to the file it refers to
+    token = strtok(NULL, SPLIT_ARGS_CHAR);
+    PSEUDO_INODE *inode = get_inode(fs, token, 0);
+    if (inode != NULL && inode->isSLink == true) {
+        inode = &fs->inodes->data[inode->linked_node_id];
+    }
+    if (inode == NULL) {
+        fclose(source_file);
+        return false;
+    }
+
+    // the source is streamed in chunks of IO_CHUNK_SIZE, each goes behind the current end
+    char *buffer = arena_alloc(IO_CHUNK_SIZE);
+    bool result = buffer != NULL;
+    size_t bytes;
+    while (result == true && (bytes = fread(buffer, sizeof(char), IO_CHUNK_SIZE, source_file)) > 0) {
+        result = inode_write(fs, inode, buffer, inode->file_size, (int64_t) bytes) == (int64_t) bytes;
+    }
+    fclose(source_file);
 
     // print result
     if (result == true) {
@@ -69,6 +135,8 @@ void file_in(FS *fs, char *token) {
     } else {
         printf("NOK\n");
     }
+
+    return result;
 }
 
 /**
@@ -76,8 +144,11 @@ void file_in(FS *fs, char *token) {
  *
  * @param fs - struktura file systému
  * @param path - cesta do adresáře
+ *
+ * @return  true - adresář existuje
+ *          false - jinak
  */
-void print_directory(FS *fs, char *path) {
+bool print_directory(FS *fs, char *path) {
     path = strtok(NULL, SPLIT_ARGS_CHAR);
 
     PSEUDO_INODE *dir = NULL;
@@ -90,7 +161,8 @@ void print_directory(FS *fs, char *path) {
 
     // directory exists
     if (dir != NULL) {
-        DIRECTORY_ITEMS *items = read_directory_items_from_file(fs, dir);
+        // borrowed from the cache, must not be freed
+        DIRECTORY_ITEMS *items = cache_get_directory(fs, dir);
 
         INODES *inodes = fs->inodes;
         PSEUDO_INODE *current_inode = NULL;
@@ -99,18 +171,19 @@ void print_directory(FS *fs, char *path) {
         for (int i = 0; i < items->size; i++) {
             current_inode = &inodes->data[items->data[i].node_id];
             if (current_inode->isDirectory == true) {
-                printf("+ SIZE: %ldB, PARENT_ID: %d, NODE_ID: %d, CLUSTERS: %d, NAME: %s \n",
+                printf("+ SIZE: %" PRId64 "B, PARENT_ID: %d, NODE_ID: %d, CLUSTERS: %d, NAME: %s \n",
                        current_inode->file_size, current_inode->parent_id, current_inode->node_id,
                        current_inode->count_clusters, items->data[i].item_name);
             } else {
-                printf("- SIZE: %ldB, PARENT_ID: %d, NODE_ID: %d, CLUSTERS: %d, NAME: %s \n",
+                printf("- SIZE: %" PRId64 "B, PARENT_ID: %d, NODE_ID: %d, CLUSTERS: %d, NAME: %s \n",
                        current_inode->file_size,
                        current_inode->parent_id, current_inode->node_id, current_inode->count_clusters,
                        items->data[i].item_name);
             }
         }
-        free_directory_items(items);
     }
+
+    return dir != NULL;
 }
 
 /**
@@ -118,8 +191,11 @@ void print_directory(FS *fs, char *path) {
  *
  * @param fs - struktura file systému
  * @param path - cesta k souboru
+ *
+ * @return  true - soubor byl vypsán
+ *          false - soubor neexistuje
  */
-void print_file(FS *fs, char *path) {
+bool print_file(FS *fs, char *path) {
     // get path
     path = strtok(NULL, SPLIT_ARGS_CHAR);
 
@@ -128,7 +204,7 @@ void print_file(FS *fs, char *path) {
     PSEUDO_INODE *inode2;
 
     if (inode == NULL) {
-        return;
+        return false;
     }
 
     // is node symbolic link - if yes, print file it refers to
@@ -139,40 +215,26 @@ void print_file(FS *fs, char *path) {
         inode = inode2;
     }
 
-    char *buffer = (char *) malloc(fs->superblock->cluster_size * sizeof(int));
-    if (buffer == NULL) {
-        printf("Error: can't allocate memory for buffer to print file.\n");
-        return;
-    }
-
-    // get array of all clusters with data
-    int32_t *file_clusters = get_all_file_clusters(fs, inode);
-    int32_t actual_size = inode->file_size;
+    // runs of clusters with data, the blocks of links are read one at a time
+    CLUSTER_ITERATOR iterator;
+    EXTENT run;
+    cluster_iterator_init(&iterator, inode);
 
-    for (int i = 0; i < inode->count_clusters; i++) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (file_clusters[i] * fs->superblock->cluster_size), SEEK_SET);
-
-        if (actual_size >= fs->superblock->cluster_size) {
-            fread(buffer, sizeof(char), fs->superblock->cluster_size, fs->FILE);
-            buffer[fs->superblock->cluster_size] = '\0';    // add end char
-            printf("%s", buffer);
-            actual_size -= fs->superblock->cluster_size;
-        } else {
-            fread(buffer, sizeof(char), actual_size, fs->FILE);
-            buffer[actual_size] = '\0';     // add end char
-            printf("%s", buffer);
-            break;
+    // one write per run, straight from the mapped clusters
+    int64_t actual_size = inode->file_size;
+    while (actual_size > 0 && cluster_iterator_next_run(fs, &iterator, &run) == true) {
+        size_t bytes = (size_t) run.length * fs->superblock->cluster_size;
+        if (bytes > actual_size) {
+            bytes = actual_size;
         }
+
+        fwrite(cluster_ptr(fs, run.start), sizeof(char), bytes, stdout);
+        io_count_read(bytes);
+        actual_size -= bytes;
     }
     printf("\n");
 
-    // free memory
-    if (file_clusters != NULL) {
-        free(file_clusters);
-    }
-    if (buffer != NULL) {
-        free(buffer);
-    }
+    return true;
 }
 
 /**
@@ -180,15 +242,18 @@ void print_file(FS *fs, char *path) {
  *
  * @param fs - struktura file systému
  * @param path - cesta, kde chceme složku vytvořit
+ *
+ * @return  true - složka byla vytvořena
+ *          false - jinak
  */
-void make_directory(FS *fs, char *path) {
+bool make_directory(FS *fs, char *path) {
     path = strtok(NULL, SPLIT_ARGS_CHAR);
     //printf("making dir with %s\n", path);
 
     // path incorrect
     if (path == NULL || path[strlen(path) - 2] == '/') {
         printf("PATH NOT FOUND \n");
-        return;
+        return false;
     } else if (path[strlen(path) - 1] == '\n') {
         path[strlen(path) - 1] = '\0';
     }
@@ -201,7 +266,7 @@ void make_directory(FS *fs, char *path) {
     tmp_path = get_path_to_parent(path);
     if (strlen(tmp_path) == 0) {
         printf("Error: Directory '%s/%s' could not be created,\n", tmp_path, name);
-        return;
+        return false;
     }
 
     PSEUDO_INODE *parent_inode = NULL;
@@ -212,58 +277,37 @@ void make_directory(FS *fs, char *path) {
     }
 
     if (parent_inode == NULL) {
-        return;
-    }
-
-    fs->FILE = fopen(fs->filename, "rb+");
-    if (fs->FILE == NULL) {
-        perror("Failed: \n");
-        return ;
+        return false;
     }
 
-    DIRECTORY_ITEMS *parent_dir = read_directory_items_from_file(fs, parent_inode);
-
     // directory already contains file with the same name
-    if (directory_contains_file(parent_dir, name) == true) {
+    if (directory_lookup(fs, parent_inode, name) != -1) {
         printf("EXISTS\n");
-        free_directory_items(parent_dir);
-        return;
+        return false;
     }
 
     // get free i-node
     PSEUDO_INODE *new_inode = get_free_inode(fs);
     if (new_inode == NULL) {
         printf("NO FREE I-NODES FOUND\n");
-        free_directory_items(parent_dir);
-        return;
+        return false;
     }
 
-    // increment number of items in directory
-    parent_dir->size = parent_dir->size + 1;
-
-    // realloc memory
-    parent_dir->data = realloc(parent_dir->data, parent_dir->size * sizeof(DIRECTORY_ITEM));
-
-    strcpy(parent_dir->data[parent_dir->size - 1].item_name, name);
-    parent_dir->data[(parent_dir->size - 1)].node_id = new_inode->node_id;
-    parent_inode->file_size = sizeof(DIRECTORY_ITEMS) + parent_dir->size * sizeof(DIRECTORY_ITEM);
-
-    // write to file
-    write_directory_items_to_file(fs, parent_dir, parent_inode);
-    //lze zamenit za metodu  add_item_to_directory(fs, parent_dir, parent_inode, name, new_inode)
+    // add to the parent directory
+    if (add_item_to_directory(fs, parent_inode, name, new_inode) == false) {
+        return false;
+    }
 
     // new directory
     DIRECTORY_ITEMS *new_dir = create_directory_item(fs, parent_inode->node_id, new_inode, name);
     write_directory_items_to_file(fs, new_dir, new_inode);
 
-    // write to file
-    write_bitmap_to_file(fs);
-    write_inodes_to_file(fs);
-
     printf("OK\n");
 
     // free
-    free_directory_items(parent_dir);
+    free_directory_items(new_dir);
+
+    return true;
 }
 
 /**
@@ -272,8 +316,11 @@ void make_directory(FS *fs, char *path) {
  * @param fs - struktura file systému
  * @param path - cesta k položce
  * @param isDirectory - jde o soubor nebo adresář
+ *
+ * @return  true - položka byla odstraněna
+ *          false - jinak
  */
-void remove_file_or_directory(FS *fs, char *path, bool isDirectory) {
+bool remove_file_or_directory(FS *fs, char *path, bool isDirectory) {
     path = strtok(NULL, SPLIT_ARGS_CHAR);
 
     PSEUDO_INODE *inode_to_remove = NULL;
@@ -283,7 +330,7 @@ void remove_file_or_directory(FS *fs, char *path, bool isDirectory) {
 
     if ((path != NULL && strcmp(path, ".\n") == 0) || (path != NULL && strcmp(temp_path, "..") == 0)) {
         printf("FILE NOT FOUND \n");
-        return;
+        return false;
     }
 
     // get i-node
@@ -294,7 +341,7 @@ void remove_file_or_directory(FS *fs, char *path, bool isDirectory) {
     }
 
     if (inode_to_remove == NULL) {
-        return;
+        return false;
     }
 
     // is directory empty?
@@ -302,52 +349,37 @@ void remove_file_or_directory(FS *fs, char *path, bool isDirectory) {
         DIRECTORY_ITEMS *dir = read_directory_items_from_file(fs, inode_to_remove);
         if (dir->size > 2) {
             printf("NOT EMPTY \n");
-            return;
+            return false;
         }
         free_directory_items(dir);
     }
 
     // delete i-node
-    bool result = delete_inode(fs, inode_to_remove);
+    char *name = get_filename_from_path(path);
+    bool result = delete_inode(fs, inode_to_remove, name);
     if (result == false) {
-        return;
-    }
-
-    // free clusters
-    int32_t *file_clusters = get_all_file_clusters(fs, inode_to_remove);
-
-    for (int j = 0; j < inode_to_remove->count_clusters; j++) {
-        fs->bitmap->cluster_free[file_clusters[j]] = true;
-    }
-    if (inode_to_remove->indirect1 != -1) {
-        fs->bitmap->cluster_free[inode_to_remove->indirect1] = true;
-    }
-    if (inode_to_remove->indirect2 != -1) {
-        fs->bitmap->cluster_free[inode_to_remove->indirect2] = true;
-    }
-
-    int32_t directs[COUNT_DIRECT_LINK];
-    for (int j = 0; j < COUNT_DIRECT_LINK; j++) {
-        directs[j] = -1;
+        return false;
     }
 
-    // free i-node
-    init_pseudoinode(fs, inode_to_remove->node_id, -1, true, false, -1, -1, directs, -1, -1);
-
-    // write to file
-    write_bitmap_to_file(fs);
-    write_inodes_to_file(fs);
+    // free clusters and i-node
+    release_inode(fs, inode_to_remove);
 
     printf("OK\n");
+
+    return true;
 }
 
 /**
- * Zkopíruje soubor do složky.
+ * Zkopíruje soubor do složky. Data se nekopírují, nový i-node sdílí clustery zdrojového souboru
+ * (copy-on-write), zvýší se jen jejich počet referencí.
  *
  * @param fs - struktura file systému
  * @param token - argumenty příkazu
+ *
+ * @return  true - soubor byl zkopírován
+ *          false - jinak
  */
-void copy_file(FS *fs, char *token) {
+bool copy_file(FS *fs, char *token) {
     // get arguments
     char *src_path = strtok(NULL, SPLIT_ARGS_CHAR);
     char *dest_path = strtok(NULL, SPLIT_ARGS_CHAR);
@@ -355,184 +387,60 @@ void copy_file(FS *fs, char *token) {
     PSEUDO_INODE *src_inode = NULL;
     PSEUDO_INODE *dest_inode = NULL;
     PSEUDO_INODE *new_inode = NULL;
-    DIRECTORY_ITEMS *dest_dir = NULL;
 
     // get source i-node
     src_inode = get_inode(fs, src_path, 0);
     char *filename = get_filename_from_path(src_path);
     if (src_inode == NULL) {
-        return;
+        return false;
     }
 
     // get destination i-node
     dest_inode = get_inode(fs, dest_path, 1);
     if (dest_inode == NULL) {
-        return;
+        return false;
     }
 
     // get free i-node
     new_inode = get_free_inode(fs);
     if (new_inode == NULL) {
         printf("NO FREE I-NODES FOUND\n");
-        free_directory_items(dest_dir);
-        return;
+        return false;
     }
 
-    // get destination directory
-    dest_dir = read_directory_items_from_file(fs, dest_inode);
-    if (directory_contains_file(dest_dir, filename) == true) {
+    // destination directory must not contain the same name
+    if (directory_lookup(fs, dest_inode, filename) != -1) {
         printf("FILE ALREADY EXISTS IN THIS DIRECTORY \n");
-        free_directory_items(dest_dir);
-        return;
-    }
-
-    // number of clusters we need
-    int32_t n_of_clusters = src_inode->count_clusters;
-    if (src_inode->indirect1 != -1) {
-        n_of_clusters++;
-    }
-    if (src_inode->indirect2 != -1) {
-        n_of_clusters++;
-    }
-
-    if (find_free_clusters(fs, n_of_clusters) == false) {
-        printf("NOT ENOUGH FREE CLUSTERS FOUND\n");
-    }
-
-    // how many indirect link do we need?
-    int32_t cluster_overflow = 0;
-    if (src_inode->count_clusters - COUNT_DIRECT_LINK >= 0) {
-        cluster_overflow = src_inode->count_clusters - COUNT_DIRECT_LINK;
+        return false;
     }
 
-    int32_t indirects[cluster_overflow];
-    int32_t directs[COUNT_DIRECT_LINK];
-    for (int i = 0; i < COUNT_DIRECT_LINK; i++) {
-        directs[i] = -1;
-    }
-
-    int32_t *file_clusters = get_all_file_clusters(fs, src_inode);
-
-    for (int i = 0; i < src_inode->count_clusters; i++) {
-        if (i < COUNT_DIRECT_LINK) {
-            directs[i] = file_clusters[i];
-        } else {
-            indirects[i - COUNT_DIRECT_LINK] = file_clusters[i];
-        }
-    }
-
-    // both indirect links used
-    if (src_inode->indirect1 != -1 && src_inode->indirect2 != -1) {
-        new_inode = init_pseudoinode(fs, new_inode->node_id, dest_inode->node_id, false, false, src_inode->file_size,
-                                     src_inode->count_clusters, directs, get_cluster(fs), get_cluster(fs));
-    }
-    // only the first indirect link used
-    else if (src_inode->indirect1 != -1 && src_inode->indirect2 == -1) {
-        new_inode = init_pseudoinode(fs, new_inode->node_id, dest_inode->node_id, false, false, src_inode->file_size,
-                                     src_inode->count_clusters, directs, get_cluster(fs), -1);
-    }
-    // no indirect links
-    else {
-        new_inode = init_pseudoinode(fs, new_inode->node_id, dest_inode->node_id, false, false, src_inode->file_size,
-                                     src_inode->count_clusters, directs, -1, -1);
+    // all clusters of the source, blocks of links included
+    if (inode_clusters_shareable(fs, src_inode) == false) {
+        printf("TOO MANY COPIES OF THE FILE\n");
+        return false;
     }
 
     // add item to the new directory
-    add_item_to_directory(fs, dest_dir, dest_inode, filename, new_inode);
-
-    // data
-    char **buffer = malloc(n_of_clusters * sizeof(char *));
-    for (int i = 0; i < n_of_clusters; i++) {
-        buffer[i] = (char *) malloc((fs->superblock->cluster_size + 1) * sizeof(char));
-    }
-
-    int32_t actual_size = new_inode->file_size;
-    for (int i = 0; i < new_inode->count_clusters; i++) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (file_clusters[i] * fs->superblock->cluster_size),
-              SEEK_SET);
-        if (actual_size >= fs->superblock->cluster_size) {
-            fread(buffer[i], sizeof(char), fs->superblock->cluster_size, fs->FILE);
-            buffer[i][fs->superblock->cluster_size] = '\0';
-            actual_size -= fs->superblock->cluster_size;
-        } else {
-            fread(buffer[i], sizeof(char), actual_size, fs->FILE);
-            buffer[i][actual_size] = '\0';
-        }
+    if (add_item_to_directory(fs, dest_inode, filename, new_inode) == false) {
+        return false;
     }
 
-    fclose(fs->FILE);
-    fs->FILE = fopen(fs->filename, "rb+");
-
-
-    int32_t n_of_indirects = 0;
-    if (new_inode->indirect1 != -1) {
-        n_of_indirects++;
-    }
-    if (new_inode->indirect2 != -1) {
-        n_of_indirects++;
+    // clone the i-node, it points to the same clusters as the source
+    new_inode = init_pseudoinode(fs, new_inode->node_id, dest_inode->node_id, false, false, src_inode->file_size,
+                                 src_inode->count_clusters, src_inode->directs, src_inode->indirect1,
+                                 src_inode->indirect2);
+    new_inode->indirect_double = src_inode->indirect_double;
+    new_inode->indirect_triple = src_inode->indirect_triple;
+    if (src_inode->isExtent == true) {
+        set_inode_extents(new_inode, src_inode->extents, COUNT_EXTENTS);
     }
 
-    // number of clusters that needs to use indirect links
-    int32_t cluster_overflow_2 = new_inode->count_clusters - COUNT_DIRECT_LINK;
-    // how many int32 can go to one cluster
-    int32_t ints_in_cluster = fs->superblock->cluster_size / sizeof(int32_t);
-
-    // go through clusters
-    for (int i = 0; i < new_inode->count_clusters; i++) {
-        if (i < COUNT_DIRECT_LINK) {
-            fseek(fs->FILE,fs->superblock->data_start_address + (new_inode->directs[i] * fs->superblock->cluster_size), SEEK_SET);
-        } else {
-            fseek(fs->FILE, fs->superblock->data_start_address + (indirects[i - COUNT_DIRECT_LINK] * fs->superblock->cluster_size), SEEK_SET);
-        }
-
-        if (actual_size >= fs->superblock->cluster_size) {
-            fwrite(buffer[i], sizeof(char), fs->superblock->cluster_size, fs->FILE);
-            actual_size -= fs->superblock->cluster_size;
-        } else {
-            fwrite(buffer[i], sizeof(char), actual_size, fs->FILE);
-            break;
-        }
-    }
-
-    fflush(fs->FILE);
-
-    // indirect links
-    if (n_of_indirects == 1) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (new_inode->indirect1 * fs->superblock->cluster_size), SEEK_SET);
-        fwrite(indirects, sizeof(int32_t), cluster_overflow_2, fs->FILE);
-        fflush(fs->FILE);
-    } else if (n_of_indirects == 2) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (new_inode->indirect1 * fs->superblock->cluster_size), SEEK_SET);
-        fwrite(indirects, sizeof(int32_t), ints_in_cluster, fs->FILE);
-        fflush(fs->FILE);
-
-        int32_t data_links[cluster_overflow_2 - ints_in_cluster];
-        int index = 0;
-        for (int i = ints_in_cluster; i <= ints_in_cluster +(cluster_overflow_2 - ints_in_cluster); ++i) {
-            data_links[index] = indirects[i];
-            index++;
-        }
-
-        fseek(fs->FILE, fs->superblock->data_start_address + (new_inode->indirect2 * fs->superblock->cluster_size), SEEK_SET);
-
-        fwrite(data_links, sizeof(int32_t),(cluster_overflow_2 - ints_in_cluster), fs->FILE);
-        fflush(fs->FILE);
-    }
-
-    // free memory
-    for (int i = 0; i < new_inode->count_clusters; i++) {
-        char *currentIntPtr = buffer[i];
-        free(currentIntPtr);
-    }
-    if(buffer) {
-        free(buffer);
-    }
-
-    // write to file
-    write_bitmap_to_file(fs);
-    write_inodes_to_file(fs);
+    // data are shared, only the references are counted
+    inode_share_clusters(fs, src_inode);
 
     printf("OK\n");
+
+    return true;
 }
 
 /**
@@ -540,15 +448,18 @@ void copy_file(FS *fs, char *token) {
  *
  * @param fs - struktura file systému
  * @param token - argumenty příkazu - výchozí a cílová cesta
+ *
+ * @return  true - soubor byl přesunut nebo přejmenován
+ *          false - jinak
  */
-void move_file(FS *fs, char *token) {
+bool move_file(FS *fs, char *token) {
     char *src_path = strtok(NULL, SPLIT_ARGS_CHAR);
     char *dest_path = strtok(NULL, SPLIT_ARGS_CHAR);
 
     // get source i-node
     PSEUDO_INODE *src_inode = get_inode(fs, src_path, 0);
     if (src_inode == NULL) {
-        return;
+        return false;
     }
 
     // get filename
@@ -562,48 +473,42 @@ void move_file(FS *fs, char *token) {
         printf("New name: %s\n", dest_path);
 
         PSEUDO_INODE *parent = get_parent_inode(fs, src_inode);
-        DIRECTORY_ITEMS *items = read_directory_items_from_file(fs, parent);
 
-        for (int i = 0; i < items->size; ++i) {
-            if (items->data[i].node_id == src_inode->node_id) {
-                strcpy(items->data[i].item_name, dest_path);
-            }
+        // the item is rehashed under the new name
+        if (directory_remove(fs, parent, filename) == false) {
+            return false;
+        }
+        if (directory_insert(fs, parent, dest_path, src_inode->node_id) == false) {
+            directory_insert(fs, parent, filename, src_inode->node_id);
+            return false;
         }
-        write_directory_items_to_file(fs, items, parent);
-        // write to file
-        write_inodes_to_file(fs);
-        write_bitmap_to_file(fs);
 
-        return;
+        return true;
     }
 
-    // get directory
-    DIRECTORY_ITEMS *directory_destination = read_directory_items_from_file(fs, dest_inode);
-    if (directory_contains_file(directory_destination, filename) == true) {
+    // destination directory must not contain the same name
+    if (directory_lookup(fs, dest_inode, filename) != -1) {
         printf("FILE ALREADY EXISTS THIS IN DIRECTORY \n");
-        free_directory_items(directory_destination);
-        return;
+        return false;
     }
 
     // delete file from previous parent directory
     INODES *inodes = fs->inodes;
     PSEUDO_INODE *prev_parent = &inodes->data[src_inode->parent_id];
-    bool result = delete_inode(fs, src_inode);
+    bool result = delete_inode(fs, src_inode, filename);
     if (result == false) {
-        return;
+        return false;
     }
 
-    // add to the new directory
-    src_inode->parent_id = dest_inode->node_id;
-    add_item_to_directory(fs, directory_destination, dest_inode, filename, src_inode);
-
-    // write to file
-    write_inodes_to_file(fs);
-    write_bitmap_to_file(fs);
-
-    free_directory_items(directory_destination);
+    // add to the new directory, the old place is restored if the destination is full
+    if (add_item_to_directory(fs, dest_inode, filename, src_inode) == false) {
+        add_item_to_directory(fs, prev_parent, filename, src_inode);
+        return false;
+    }
 
     printf("OK\n");
+
+    return true;
 }
 
 /**
@@ -611,8 +516,11 @@ void move_file(FS *fs, char *token) {
  *
  * @param fs - struktura file systému
  * @param path - cesta k adresáři
+ *
+ * @return  true - adresář byl změněn
+ *          false - adresář neexistuje
  */
-void change_directory(FS *fs, char *path) {
+bool change_directory(FS *fs, char *path) {
     path = strtok(NULL, SPLIT_ARGS_CHAR);
     char tmp_path[PATH_MAX];
 
@@ -629,7 +537,7 @@ void change_directory(FS *fs, char *path) {
 
     // directory not found
     if (dir == NULL) {
-        return;
+        return false;
     }
 
     if (dir->node_id == 0) {
@@ -644,21 +552,23 @@ void change_directory(FS *fs, char *path) {
             }
         }
     } else {
-        fs->actual_path = get_absolute_path(fs, path);
+        strcpy(fs->actual_path, get_absolute_path(fs, path));
     }
 
     // set new working directory
-    DIRECTORY_ITEMS *directory = read_directory_items_from_file(fs, dir);
-    fs->current_directory = directory;
     fs->current_inode = dir;
+
+    return true;
 }
 
 /**
  * Vytiskne aktuální cestu.
  *
  * @param fs - struktura file systému
+ *
+ * @return true
  */
-void print_working_directory(FS *fs) {
+bool print_working_directory(FS *fs) {
     char path[PATH_MAX];
 
     if (strlen(fs->actual_path) > 0) {
@@ -667,6 +577,8 @@ void print_working_directory(FS *fs) {
         strcpy(path, "/");
     }
     printf("%s \n", path);
+
+    return true;
 }
 
 /**
@@ -674,20 +586,22 @@ void print_working_directory(FS *fs) {
  *
  * @param fs - struktura file systému
  * @param path cesta, která vede k danému souboru
+ *
+ * @return  true - soubor byl nalezen
+ *          false - jinak
  */
-void print_info(FS *fs, char *path) {
+bool print_info(FS *fs, char *path) {
     path = strtok(NULL, SPLIT_ARGS_CHAR);
 
     // get i-node on path
     PSEUDO_INODE *inode = get_inode(fs, path, 2);
+    bool file_found = false;
 
     // i-node exists
     if (inode != NULL) {
         PSEUDO_INODE *parent = get_parent_inode(fs, inode);
         DIRECTORY_ITEMS *items = read_directory_items_from_file(fs, parent);
 
-        bool file_found = false;
-
         for (int i = 0; i < items->size; ++i) {
             if (items->data[i].node_id == inode->node_id) {
                 // node is symbolic link
@@ -695,28 +609,34 @@ void print_info(FS *fs, char *path) {
                     PSEUDO_INODE *inode2 = &fs->inodes->data[inode->linked_node_id];
                     for (int j = 0; j < items->size; ++j) {
                         if (items->data[j].node_id == inode->linked_node_id) {
-                            printf("NAME: %s - SIZE: %ldB - I-NODE_ID: %d - ",
+                            printf("NAME: %s - SIZE: %" PRId64 "B - I-NODE_ID: %d - ",
                                    items->data[j].item_name, inode2->file_size, inode2->node_id);
 
                             for (int m = 0; m < COUNT_DIRECT_LINK; m++) {
                                 printf("di: %d, ", inode2->directs[m]);
                             }
                             printf("ind: %d, ", inode2->indirect1);
-                            printf("ind: %d \n", inode2->indirect2);
+                            printf("ind: %d, ", inode2->indirect2);
+                            printf("dind: %d, ", inode2->indirect_double);
+                            printf("tind: %d", inode2->indirect_triple);
+                            print_extents(inode2);
                         }
                     }
 
                 }
                 // node is a file
                 else {
-                    printf("NAME: %s - SIZE: %ldB - I-NODE_ID: %d - ", items->data[i].item_name,
+                    printf("NAME: %s - SIZE: %" PRId64 "B - I-NODE_ID: %d - ", items->data[i].item_name,
                            inode->file_size, inode->node_id);
 
                     for (int m = 0; m < COUNT_DIRECT_LINK; m++) {
                         printf("di: %d, ", inode->directs[m]);
                     }
                     printf("ind: %d, ", inode->indirect1);
-                    printf("ind: %d \n", inode->indirect2);
+                    printf("ind: %d, ", inode->indirect2);
+                    printf("dind: %d, ", inode->indirect_double);
+                    printf("tind: %d", inode->indirect_triple);
+                    print_extents(inode);
                 }
 
                 file_found = true;
@@ -729,6 +649,8 @@ void print_info(FS *fs, char *path) {
         }
         free_directory_items(items);
     }
+
+    return file_found;
 }
 
 /**
@@ -736,14 +658,17 @@ void print_info(FS *fs, char *path) {
  *
  * @param fs - struktura file systému
  * @param token - argumenty příkazu
+ *
+ * @return  true - soubor byl zapsán na disk
+ *          false - jinak
  */
-void file_out(FS *fs, char *token) {
+bool file_out(FS *fs, char *token) {
     char *src_file = strtok(NULL, SPLIT_ARGS_CHAR);
     char *dest_path = strtok(NULL, SPLIT_ARGS_CHAR);
 
     if (dest_path == NULL) {
         printf("PATH NOT FOUND \n");
-        return;
+        return false;
     }
     if (dest_path[strlen(dest_path) - 1] == '\n') {
         dest_path[strlen(dest_path) - 1] = '\0';
@@ -753,20 +678,17 @@ void file_out(FS *fs, char *token) {
     PSEUDO_INODE *source_inode = get_inode(fs, src_file, 0);
     char *filename_source = get_filename_from_path(src_file);
     if (source_inode == NULL) {
-        return;
+        return false;
     }
 
     FILE *OUTPUT_FILE = NULL;
+    // errno may be left over from an earlier call, only the result of opendir is reliable
     DIR *dir = opendir(dest_path);
-    if (ENOENT == errno) {
-        printf("PATH NOT FOUND\n");
-        closedir(dir);
-        return;
-    } else if (dir == NULL) {
+    if (dir == NULL) {
         printf("PATH NOT FOUND\n");
-        closedir(dir);
-        return;
+        return false;
     }
+    closedir(dir);
     if (dest_path[strlen(dest_path) - 1] == '\n') {
         dest_path[strlen(dest_path) - 1] = '\0';
     }
@@ -778,134 +700,200 @@ void file_out(FS *fs, char *token) {
     }
     strcat(output_file, filename_source);
 
-    OUTPUT_FILE = fopen(output_file, "w");
-    OUTPUT_FILE = fopen(output_file, "rb+");
-    if (fs->FILE == NULL) {
+    OUTPUT_FILE = fopen(output_file, "wb");
+    if (OUTPUT_FILE == NULL) {
         printf("FILE CANNOT BE CREATED\n");
+        return false;
     } else {
         printf("FILE CREATED\n");
     }
 
-    // write data
-    int32_t actual_size = source_inode->file_size;
-    char *buffer = (char *) malloc(fs->superblock->cluster_size * sizeof(int));
-    if (buffer == NULL) {
-        printf("Error: could not allocate memory for buffer\n");
-    }
+    // runs of clusters with data, the blocks of links are read one at a time
+    CLUSTER_ITERATOR iterator;
+    EXTENT run;
+    cluster_iterator_init(&iterator, source_inode);
 
-    // get all file clusters
-    int32_t *file_clusters = get_all_file_clusters(fs, source_inode);
-
-    // write all file cluster to the new file
-    for (int i = 0; i < source_inode->count_clusters; i++) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (file_clusters[i] * fs->superblock->cluster_size), SEEK_SET);
-        fseek(OUTPUT_FILE, i * (fs->superblock->cluster_size * sizeof(char)), SEEK_SET);
-
-        if (actual_size >= fs->superblock->cluster_size) {
-            fread(buffer, sizeof(char), fs->superblock->cluster_size, fs->FILE);
-            if (buffer[strlen(buffer)] == '\n') {
-                buffer[strlen(buffer)] = '\0';
-            } else {
-                buffer[strlen(buffer)] = '\0';
-            }
-            if (buffer[strlen(buffer) - 1] == '\n') {
-                buffer[strlen(buffer) - 1] = '\0';
-            }
+    // write data
+    int64_t actual_size = source_inode->file_size;
+
+    // write all runs sequentially, one unbuffered write per run straight from the mapped clusters;
+    // never written clusters are holes in the image and are skipped, the output file stays sparse too
+    setvbuf(OUTPUT_FILE, NULL, _IONBF, 0);
+    bool written = true;
+    while (written == true && actual_size > 0 && cluster_iterator_next_run(fs, &iterator, &run) == true) {
+        size_t bytes = (size_t) run.length * fs->superblock->cluster_size;
+        if (bytes > actual_size) {
+            bytes = actual_size;
+        }
 
-            fwrite(buffer, sizeof(char), fs->superblock->cluster_size, OUTPUT_FILE);
-            actual_size -= fs->superblock->cluster_size;
-        } else {
-            fread(buffer, sizeof(char), actual_size, fs->FILE);
-            if (buffer[strlen(buffer)] == '\n') {
-                buffer[strlen(buffer)] = '\0';
+        size_t run_offset = cluster_ptr(fs, run.start) - fs->map;
+        size_t done = 0;
+        while (done < bytes) {
+            bool is_hole;
+            size_t part = io_extent_at(fs, run_offset + done, bytes - done, &is_hole);
+            if (is_hole == true) {
+                if (fseeko(OUTPUT_FILE, (off_t) part, SEEK_CUR) != 0) {
+                    written = false;
+                    break;
+                }
+            } else if (fwrite(cluster_ptr(fs, run.start) + done, sizeof(char), part, OUTPUT_FILE) != part) {
+                written = false;
+                break;
             } else {
-                buffer[strlen(buffer)] = '\0';
+                io_count_read(part);
             }
-            if (buffer[strlen(buffer) - 1] == '\n') {
-                buffer[strlen(buffer) - 1] = '\0';
-            }
-            fwrite(buffer, sizeof(char), actual_size, OUTPUT_FILE);
-            break;
+            done += part;
         }
+        actual_size -= bytes;
     }
 
-    // free
-    fflush(OUTPUT_FILE);
-    if (file_clusters != NULL) {
-        free(file_clusters);
+    // a hole at the end of the file sets only the position, not the size
+    if (written == true && ftruncate(fileno(OUTPUT_FILE), (off_t) source_inode->file_size) != 0) {
+        written = false;
     }
-    if (buffer != NULL) {
-        free(buffer);
+    if (fclose(OUTPUT_FILE) != 0) {
+        written = false;
     }
-    fclose(OUTPUT_FILE);
 
+    if (written == false) {
+        printf("FILE CANNOT BE WRITTEN\n");
+        return false;
+    }
     printf("OK\n");
+
+    return true;
 }
 
 /**
- * Načte soubor s příkazy a vykoná je.
+ * Načte soubor s příkazy a vykoná je jako dávku. Změny metadat zůstávají v paměti a do souboru FS
+ * jdou jednou transakcí na konci dávky (load s1), nebo po každých N příkazech (load s1 N).
+ * Dávka se zapíše i dřív, pokud by se její transakce nevešla do žurnálu.
  *
  * @param fs - struktura file systému
  * @param token - cesta k  souboru
+ *
+ * @return  true - všechny příkazy ze souboru proběhly
+ *          false - soubor neexistuje nebo některý příkaz selhal
  */
-void load_file_with_commands(FS *fs, char *token) {
+bool load_file_with_commands(FS *fs, char *token) {
     token = strtok(NULL, SPLIT_ARGS_CHAR);
     printf("token in load: %s", token);
 
     // argument missing
     if (token == NULL || token[0] == 0 || strlen(token) == 0) {
         printf("FILE NOT FOUND \n");
-        return;
+        return false;
     }
-    if (token[strlen(token) - 1] == '\n') {
-        token[strlen(token) - 1] = '\0';
+    token[strcspn(token, "\n")] = '\0';
+    char *filename = token;
+
+    // optional - commit after every N commands, 0 = once for the whole file
+    int32_t sync_every = 0;
+    token = strtok(NULL, SPLIT_ARGS_CHAR);
+    if (token != NULL) {
+        sync_every = atoi(token);
+        if (sync_every < 0) {
+            printf("WRONG NUMBER OF COMMANDS \n");
+            return false;
+        }
     }
+    token = filename;
 
     // open file
     FILE *fp = fopen(token, "r");
     if (fp == NULL) {
         printf("FILE NOT FOUND \n");
-        return;;
+        return false;
     }
 
     //fclose(fs->FILE);
 
-    char buffer[256];
-    // -1 to allow room for NULL terminator for really long string
-    while (fgets(buffer, 255, fp)) {
+    char buffer[MAX_COMMAND_LENGTH];
+    int32_t n_of_commands = 0;
+    bool result = true;
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        // a line that doesn't fit is refused whole, its tail must not run as another command
+        if (strchr(buffer, '\n') == NULL && feof(fp) == 0) {
+            int c = getc(fp);
+            if (c != '\n' && c != EOF) {
+                while (c != '\n' && c != EOF) {
+                    c = getc(fp);
+                }
+                printf("COMMAND TOO LONG\n");
+                result = false;
+                continue;
+            }
+        }
         buffer[strcspn(buffer, "\n")] = 0;
         printf("%s\n", buffer);
-
-        //fflush(fs->FILE);
-        //fs->FILE = fopen(fs->filename, "rb+");
+        trace_record(buffer);
 
         char *token2 = strtok(buffer, SPLIT_ARGS_CHAR);
-        commands(fs, token2);
+        if (token2 == NULL) {
+            continue;
+        }
+        if (commands(fs, token2) == false) {
+            result = false;
+        }
+        n_of_commands++;
 
-        //fclose(fs->FILE);
-        //fflush(fs->FILE);
+        // group commit
+        if ((sync_every > 0 && n_of_commands % sync_every == 0) || io_should_flush(fs) == true) {
+            io_flush(fs);
+        }
     }
 
     fclose(fp);
 
+    return result;
 }
 
 /**
- * Naformátuje systém.
+ * Převede velikost clusteru s jednotkou (4KB, 64K, 1MB) na bajty. Jednotky jsou binární,
+ * K = 1024 a M = 1024 * 1024, velikost clusteru je mocnina dvou.
+ *
+ * @param token - velikost s jednotkou
  *
+ * @return velikost clusteru v bajtech, -1 = neznámá jednotka
+ */
+int32_t parse_cluster_size(char *token) {
+    int length = index_of_last_digit(token);
+    if (length == 0 || length > 7) {
+        return -1;
+    }
+    int64_t size = atoi(token);
+    char *unit = token + length;
+
+    if (strcmp(unit, "K") == 0 || strcmp(unit, "KB") == 0) {
+        size *= 1024;
+    } else if (strcmp(unit, "M") == 0 || strcmp(unit, "MB") == 0) {
+        size *= 1024 * 1024;
+    } else if (strcmp(unit, "B") != 0) {
+        return -1;
+    }
+
+    return size > CLUSTER_SIZE_MAX ? -1 : (int32_t) size;
+}
+
+/**
+ * Naformátuje systém. Volitelné argumenty určují počet i-nodů (číslo, format 600MB 50000)
+ * a velikost clusteru (s jednotkou, format 600MB 64KB), v libovolném pořadí. Jinak se počet
+ * i-nodů odvodí z velikosti disku a cluster má CLUSTER_SIZE bajtů.
+ *
+ * @param fs - struktura file systému, jejíž soubor se přeformátuje
  * @param token argumentz příkazu format
- * @param filename název file systému
  * @param signature jméno uživatele
  * @param descriptor informace o systému
  *
  * @return FS struktura
  */
-FS *format_fs(char *token, char *filename, char *signature, char *descriptor) {
+FS *format_fs(FS *fs, char *token, char *signature, char *descriptor) {
     token = strtok(NULL, SPLIT_ARGS_CHAR);
     if (token == NULL) {
         printf("CANNOT CREATE FILE\n");
         return NULL;
     }
+    token[strcspn(token, "\n")] = '\0';
 
     int length = index_of_last_digit(token);
     char number[length + 1];
@@ -919,27 +907,69 @@ FS *format_fs(char *token, char *filename, char *signature, char *descriptor) {
         return NULL;
     }
 
-    int real_size = (strlen(token) - length) - 1;
+    int real_size = strlen(token) - length;
     char multiple[real_size];
 
     int j = 0;
-    for (int i = length; i < strlen(token) - 1; i++) {
+    for (int i = length; i < strlen(token); i++) {
         multiple[j] = token[i];
         j++;
     }
-    int real_number = handle_bytes(multiple, real_size);
-    int disk_size = atoi(number) * real_number;
+    int64_t real_number = handle_bytes(multiple, real_size);
+    int64_t disk_size = strtoll(number, NULL, 10);
+    if (disk_size > INT64_MAX / real_number) {
+        printf("CANNOT CREATE FILE\n");
+        return NULL;
+    }
+    disk_size *= real_number;
     if (disk_size <= 0) {
         printf("CANNOT CREATE FILE\n");
         return NULL;
     }
 
+    // optional i-node count and cluster size
+    int32_t inode_count = 0;
+    int32_t cluster_size = CLUSTER_SIZE;
+    while ((token = strtok(NULL, SPLIT_ARGS_CHAR)) != NULL) {
+        token[strcspn(token, "\n")] = '\0';
+        if (token[0] == '\0') {
+            continue;
+        }
+
+        if (token[index_of_last_digit(token)] == '\0') {
+            inode_count = atoi(token);
+            if (inode_count <= 0) {
+                printf("CANNOT CREATE FILE\n");
+                return NULL;
+            }
+        } else {
+            cluster_size = parse_cluster_size(token);
+            if (is_cluster_size_valid(cluster_size) == false) {
+                printf("WRONG CLUSTER SIZE (POWER OF TWO FROM 4KB TO 1MB)\n");
+                return NULL;
+            }
+        }
+    }
+
+    // release the old mapping, the file is recreated with the new size
+    io_close(fs);
+
     // initialize FS
-    FS *fs = fs_init(filename, signature, descriptor, disk_size, 0);
+    FS *new_fs = fs_init(fs->filename, signature, descriptor, disk_size, cluster_size, inode_count, 0);
+    if (new_fs == NULL) {
+        // keep working with the old image
+        io_open(fs, 0, false);
+        load_fs_from_file(fs);
+        printf("CANNOT CREATE FILE\n");
+        return NULL;
+    }
+
+    // cached directories belong to the old image
+    cache_free(fs->cache);
 
     printf("OK\n");
 
-    return fs;
+    return new_fs;
 }
 
 /**
@@ -951,8 +981,8 @@ FS *format_fs(char *token, char *filename, char *signature, char *descriptor) {
  *
  * @return násobek
  */
-int handle_bytes(char *size, int size_digits) {
-    int multiple_number = 1;
+int64_t handle_bytes(char *size, int size_digits) {
+    int64_t multiple_number = 1;
     char unit[size_digits];
     strncpy(unit, size, size_digits);
 
@@ -960,7 +990,7 @@ int handle_bytes(char *size, int size_digits) {
         case 2:
             switch(unit[0]) {
                 case 'G':
-                    multiple_number = 1000 * 1000 * 1000;
+                    multiple_number = 1000LL * 1000 * 1000;
                     break;
                 case 'M':
                     multiple_number = 1000 * 1000;
@@ -992,11 +1022,8 @@ int handle_bytes(char *size, int size_digits) {
  * @return délka řetězce číslic
  */
 int index_of_last_digit(char *number) {
-    char tmp[strlen(number)];
-    strcpy(tmp, number);
-
     int index = 0;
-    while(isdigit(tmp[index])) {
+    while(isdigit((unsigned char) number[index])) {
         index++;
     }
 
@@ -1008,8 +1035,11 @@ int index_of_last_digit(char *number) {
  *
  * @param fs - struktura file systému
  * @param token - argumenty příkazu
+ *
+ * @return  true - link byl vytvořen
+ *          false - jinak
  */
-void create_slink(FS *fs, char *token) {
+bool create_slink(FS *fs, char *token) {
     char source_filename[MAX_FILENAME_LENGTH];  // name of the file we want to link to
     char link_name[MAX_FILENAME_LENGTH];
     PSEUDO_INODE *destination_inode = NULL;
@@ -1018,11 +1048,15 @@ void create_slink(FS *fs, char *token) {
     token = strtok(NULL, SPLIT_ARGS_CHAR);
     if (token == NULL || strlen(token) < 1) {
         printf("FILE NOT FOUND\n");
-        return;
+        return false;
     }
     if (token[strlen(token) - 1] == '\n') {
         token[strlen(token) - 1] = '\0';
     }
+    if (strlen(token) >= MAX_FILENAME_LENGTH) {
+        printf("FILE NOT FOUND\n");
+        return false;
+    }
     strcpy(source_filename, token);
 
     //printf("Creating link to file: %s", source_filename);
@@ -1031,11 +1065,15 @@ void create_slink(FS *fs, char *token) {
     token = strtok(NULL, SPLIT_ARGS_CHAR);
     if (token == NULL || strlen(token) < 1) {
         printf("PATH NOT FOUND\n");
-        return;
+        return false;
     }
     if (token[strlen(token) - 1] == '\n') {
         token[strlen(token) - 1] = '\0';
     }
+    if (strlen(token) >= MAX_FILENAME_LENGTH) {
+        printf("NAME TOO LONG\n");
+        return false;
+    }
     strcpy(link_name, token);
     //printf("Creating link with name: %s", link_name);
 
@@ -1043,14 +1081,14 @@ void create_slink(FS *fs, char *token) {
     destination_inode = fs->current_inode;
 
     // create file
-    create_s_link(fs, link_name, source_filename, destination_inode);
-
-    // write changes to FS file
-    write_inodes_to_file(fs);
-    write_bitmap_to_file(fs);
+    if (create_s_link(fs, link_name, source_filename, destination_inode) == false) {
+        return false;
+    }
 
     // print result
     printf("OK\n");
+
+    return true;
 }
 
 /**
@@ -1070,10 +1108,172 @@ void print_help() {
     printf("%s - Print info about file or directory (%s s1/a1)\n", INFO, INFO);
     printf("%s - Copy file from HD to FS (%s s1 s2)\n", FILE_IN, FILE_IN);
     printf("%s - Copy file from FS to HD (%s s1 s2)\n", FILE_OUT, FILE_OUT);
-    printf("%s - Load commands from file (%s s1)\n", LOAD_COMMANDS, LOAD_COMMANDS);
-    printf("%s - Format file system (%s 600MB)\n", FORMAT, FORMAT);
+    printf("%s - Append file from HD to the end of file in FS (%s s1 s2)\n", APPEND_FILE, APPEND_FILE);
+    printf("%s - Load commands from file, commit every N commands (%s s1 [N])\n", LOAD_COMMANDS, LOAD_COMMANDS);
+    printf("%s - Format file system (%s 600MB [inodes] [4KB-1MB cluster])\n", FORMAT, FORMAT);
     printf("%s - Create symbolic link (%s s1 s2)\n", S_LINK, S_LINK);
 
     printf("%s - Print file system (%s)\n", PRINT_FS, PRINT_FS);
+    printf("%s - Print command and I/O statistics (%s [json|reset])\n", PRINT_STATS, PRINT_STATS);
     printf("%s - Quit (%s)\n\n", QUIT, QUIT);
-}
\ No newline at end of file
+}
+
+/**
+ * Handles commands from user.
+ *
+ * @return true if the command succeeded, false otherwise
+ */
+static bool dispatch_command(FS *fs, char *token) {
+    // incp - nahraje soubor s1 z pevného disku do umístění s2 v pseudoNTFS
+    if (strcmp(token, FILE_IN) == 0) {
+        return file_in(fs, token);
+    }
+    // ls - print directory
+    else if (are_strings_equal(token, PRINT_DIRECTORY) == true) {
+        return print_directory(fs, token);
+    }
+    // cat - print file
+    else if (strcmp(token, PRINT_FILE) == 0) {
+        return print_file(fs, token);
+    }
+    // mkdir - create directory
+    else if (strcmp(token, MAKE_DIRECTORY) == 0) {
+        return make_directory(fs, token);
+    }
+    // rm - remove file
+    else if (strcmp(token, REMOVE_FILE) == 0) {
+        return remove_file_or_directory(fs, token, false);
+    }
+    // rmdir - remove directory
+    else if (strcmp(token, REMOVE_EMPTY_DIRECTORY) == 0) {
+        return remove_file_or_directory(fs, token, true);
+    }
+    // cp - copy file
+    else if (strcmp(token, COPY_FILE) == 0) {
+        return copy_file(fs, token);
+    }
+    // mv - move file
+    else if (strcmp(token, MOVE_FILE) == 0) {
+        return move_file(fs, token);
+    }
+    // cd - change directory
+    else if (strcmp(token, CHANGE_DIRECTORY) == 0) {
+        return change_directory(fs, token);
+    }
+    // pwd - print working directory
+    else if (are_strings_equal(token, PRINT_WORKING_DIRECTORY) == true) {
+        return print_working_directory(fs);
+    }
+    // info - print info about file or directory
+    else if (strcmp(token, INFO) == 0) {
+        return print_info(fs, token);
+    }
+    // outcp - nahraje soubor s1 z pseudoNTFS do umístění s2 na pevném disku
+    else if (strcmp(token, FILE_OUT) == 0) {
+        return file_out(fs, token);
+    }
+    // append - připojí soubor s1 z pevného disku na konec souboru s2 v pseudoNTFS
+    else if (strcmp(token, APPEND_FILE) == 0) {
+        return append_file(fs, token);
+    }
+    // load
+    else if (strcmp(token, LOAD_COMMANDS) == 0) {
+        printf("load\n");
+        return load_file_with_commands(fs, token);
+    }
+    // format
+    else if (strcmp(token, FORMAT) == 0) {
+        FS *new_fs = format_fs(fs, token, SIGNATURE, DESCRIPTOR);
+        if (new_fs == NULL) {
+            return false;
+        }
+        *fs = *new_fs;
+        free(new_fs);
+        if (isInteractive) {
+            print_fs(fs);
+        }
+    }
+    // slink - creates symbolic link
+    else if(strcmp(token, S_LINK) == 0) {
+        return create_slink(fs, token);
+    }
+    // quit
+    else if(are_strings_equal(token, QUIT) == true) {
+        isRunning = 0;
+    }
+    // print FS
+    else if(are_strings_equal(token, PRINT_FS) == true) {
+        print_fs(fs);
+    }
+    // print help
+    else if(are_strings_equal(token, HELP) == true) {
+        print_help(fs);
+    }
+    // stats - print statistics
+    else if (are_strings_equal(token, PRINT_STATS) == true) {
+        return print_statistics(fs, token);
+    }
+    else {
+        printf("Command not found.");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handles commands from user and records their duration and I/O for the stats command.
+ * Temporaries of the command are allocated from the arena and released when it returns,
+ * a nested command (load) releases only its own.
+ *
+ * @param fs - struktura file systému
+ * @param token - name of the command, the arguments follow in strtok
+ *
+ * @return  true - the command succeeded
+ *          false - otherwise
+ */
+bool commands(FS *fs, char *token) {
+    char name[STATS_NAME_LENGTH];
+    snprintf(name, sizeof(name), "%s", token);
+
+    IO_COUNTERS before;
+    stats_begin(&before);
+    int64_t start = stats_now();
+    ARENA_MARK mark = arena_mark();
+
+    bool result = dispatch_command(fs, token);
+
+    arena_release(mark);
+    stats_record(name, result, stats_now() - start, &before);
+    return result;
+}
+
+/**
+ * Vypíše statistiky příkazů a I/O, s argumentem json jako JSON, s argumentem reset je vynuluje.
+ *
+ * @param fs - struktura file systému
+ * @param token - argumenty příkazu
+ *
+ * @return  true - úspěch
+ *          false - neznámý argument
+ */
+bool print_statistics(FS *fs, char *token) {
+    token = strtok(NULL, SPLIT_ARGS_CHAR);
+    if (token != NULL) {
+        token[strcspn(token, "\n")] = '\0';
+    }
+
+    if (token == NULL || token[0] == '\0') {
+        print_stats();
+    } else if (strcmp(token, "json") == 0) {
+        print_stats_json(stdout);
+    } else if (strcmp(token, "reset") == 0) {
+        stats_reset();
+        printf("OK\n");
+    } else {
+        printf("WRONG ARGUMENT\n");
+        return false;
+    }
+
+    return true;
+}
@@ -5,25 +5,31 @@
 #ifndef ZOS_COMMANDS_H
 #define ZOS_COMMANDS_H
 
-
-void file_in(FS *fs, char *token);
-void print_directory(FS *fs, char *path);
-void print_file(FS *fs, char *path);
-void make_directory(FS *fs, char *path);
-void remove_file_or_directory(FS *fs, char *path, bool isDirectory);
-void copy_file(FS *fs, char *token);
-void move_file(FS *fs, char *token);
-void change_directory(FS *fs, char *path);
-void print_working_directory(FS *fs);
-void print_info(FS *fs, char *path);
-void file_out(FS *fs, char *token);
-void load_file_with_commands(FS *fs, char *token);
-FS *format_fs(char *token, char *filename, char *signature, char *descriptor);
-
-int handle_bytes(char *size, int size_digits);
+extern int isRunning;
+extern int isInteractive;
+
+bool commands(FS *fs, char *token);
+bool file_in(FS *fs, char *token);
+bool append_file(FS *fs, char *token);
+bool print_directory(FS *fs, char *path);
+bool print_file(FS *fs, char *path);
+bool make_directory(FS *fs, char *path);
+bool remove_file_or_directory(FS *fs, char *path, bool isDirectory);
+bool copy_file(FS *fs, char *token);
+bool move_file(FS *fs, char *token);
+bool change_directory(FS *fs, char *path);
+bool print_working_directory(FS *fs);
+bool print_info(FS *fs, char *path);
+bool file_out(FS *fs, char *token);
+bool load_file_with_commands(FS *fs, char *token);
+bool print_statistics(FS *fs, char *token);
+FS *format_fs(FS *fs, char *token, char *signature, char *descriptor);
+
+int64_t handle_bytes(char *size, int size_digits);
+int32_t parse_cluster_size(char *token);
 int index_of_last_digit(char *number);
 
-void create_slink(FS *fs, char *path);
+bool create_slink(FS *fs, char *path);
 
 void print_help();
 
@@ -5,9 +5,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 #include "directory.h"
 #include "fs.h"
 #include "inodes.h"
+#include "io.h"
+#include "cache.h"
 
 /**
  * Vytvoří directory item a inicializuje v něm dva další soubory typu directory item - sebe a odkaz na parenta.
@@ -45,12 +48,13 @@ DIRECTORY_ITEMS *create_directory_item(FS *fs, int32_t parent_node_id, PSEUDO_IN
     items->data[1].node_id = parent_node_id;
 
     inode->isDirectory = true;
-    inode->is_free = false;
     inode->parent_id = parent_node_id;
+    set_inode_free(fs, inode, false);
     inode->file_size = sizeof(items) + items->size * sizeof(DIRECTORY_ITEM);
 
     // getting free clusters for diectory item
     assign_clusters(fs, inode);
+    write_inode_to_file(fs, inode);
 
     return items;
 }
@@ -65,19 +69,7 @@ DIRECTORY_ITEMS *create_directory_item(FS *fs, int32_t parent_node_id, PSEUDO_IN
  *          false, pokud nená
  */
 bool find_free_clusters(FS *fs, int32_t count){
-    // number of free clusters found
-    int n_of_clusters_found = 0;
-
-    for (int i = 0; i < fs->bitmap->size; ++i) {
-        if(fs->bitmap->cluster_free[i] == true){
-            n_of_clusters_found++;
-        }
-        if(n_of_clusters_found >= count) {
-            return true;
-        }
-    }
-
-    return false;
+    return fs->bitmap->free_count >= count;
 }
 
 /**
@@ -89,115 +81,310 @@ bool find_free_clusters(FS *fs, int32_t count){
  *          false, pokud ne
  */
 bool find_free_node(FS *fs) {
-    for (int i = 0; i < fs->inodes->size; ++i) {
-        if(fs->inodes->data[i].is_free == true) {
-            return true;
-        }
+    return fs->inode_bitmap->free_count > 0;
+}
+
+/**
+ * Vrátí hash jména položky adresáře (FNV-1a).
+ *
+ * @param name - jméno položky
+ *
+ * @return hash jména
+ */
+uint32_t directory_hash(char *name) {
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < MAX_FILENAME_LENGTH && name[i] != '\0'; i++) {
+        hash = (hash ^ (uint8_t) name[i]) * 16777619u;
     }
-    return false;
+
+    return hash;
 }
 
 /**
- * Zapíše do clusterů strukturu directory_items do souboru file systému.
+ * Vrátí slot hashovací tabulky adresáře. Sloty jsou uložené za sebou v clusterech adresáře,
+ * slot 0 je hlavička.
  *
  * @param fs - struktura file systému
- * @param items directory_items
- * @param inode inode příslušného datového bloku
+ * @param inode - i-node adresáře
+ * @param slot - index slotu
+ *
+ * @return ukazatel na slot v namapovaném souboru FS
  */
-void write_directory_items_to_file(FS *fs, DIRECTORY_ITEMS *items, PSEUDO_INODE *inode) {
-    int index = 0;
-    int item_size = 0;
+static DIRECTORY_ITEM *directory_slot(FS *fs, PSEUDO_INODE *inode, int32_t slot) {
+    int32_t slots_in_cluster = fs->superblock->cluster_size / sizeof(DIRECTORY_ITEM);
 
-    // number of directory items in one cluster
-    int dirs_in_cluster = fs->superblock->cluster_size / sizeof(DIRECTORY_ITEM);
+    return (DIRECTORY_ITEM *) cluster_ptr(fs, inode_get_cluster(fs, inode, slot / slots_in_cluster)) +
+           slot % slots_in_cluster;
+}
 
-    fseek(fs->FILE, fs->superblock->data_start_address + inode->directs[0] * fs->superblock->cluster_size, SEEK_SET);
-    fwrite(items, sizeof(DIRECTORY_ITEMS), 1, fs->FILE);
-    fflush(fs->FILE);
+/**
+ * Vrátí hlavičku hashovaného adresáře.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ *
+ * @return hlavička v namapovaném souboru FS
+ */
+static DIRECTORY_HEADER *directory_header(FS *fs, PSEUDO_INODE *inode) {
+    return (DIRECTORY_HEADER *) directory_slot(fs, inode, 0);
+}
 
-    DIRECTORY_ITEM *data = calloc(dirs_in_cluster, sizeof(DIRECTORY_ITEM));
+/**
+ * Vrátí slot, ve kterém je položka se zadaným jménem, případně prázdný slot, kam by patřila
+ * (lineární sondování).
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ * @param name - jméno položky
+ *
+ * @return index slotu
+ */
+static int32_t directory_find_slot(FS *fs, PSEUDO_INODE *inode, char *name) {
+    int32_t capacity = directory_header(fs, inode)->capacity;
+    int32_t position = directory_hash(name) % capacity;
+
+    while (true) {
+        DIRECTORY_ITEM *item = directory_slot(fs, inode, position + 1);
+        if (item->node_id == -1 || strncmp(item->item_name, name, MAX_FILENAME_LENGTH) == 0) {
+            return position + 1;
+        }
+        position = (position + 1) % capacity;
+    }
+}
 
+/**
+ * Vymaže hashovací tabulku adresáře přes všechny jeho clustery.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ */
+static void directory_format(FS *fs, PSEUDO_INODE *inode) {
+    int32_t slots_in_cluster = fs->superblock->cluster_size / sizeof(DIRECTORY_ITEM);
+    int32_t capacity = inode->count_clusters * slots_in_cluster - 1;
+
+    for (int i = 1; i <= capacity; i++) {
+        DIRECTORY_ITEM *item = directory_slot(fs, inode, i);
+        item->node_id = -1;
+        memset(item->item_name, 0, MAX_FILENAME_LENGTH);
+    }
     for (int i = 0; i < inode->count_clusters; i++) {
-        // copy item to data
-        if (i == 0) {
-            // v prvnim clusteru je tato DIRECTORY_ITEMS
-            fseek(fs->FILE, fs->superblock->data_start_address + inode->directs[i] * fs->superblock->cluster_size +
-                            sizeof(DIRECTORY_ITEMS), SEEK_SET);
-        } else {
-            // jinak se presunu co jiného clusteru
-            fseek(fs->FILE, fs->superblock->data_start_address + inode->directs[i] * fs->superblock->cluster_size,
-                  SEEK_SET);
-        }
+        io_mark_dirty(fs, cluster_ptr(fs, inode_get_cluster(fs, inode, i)), fs->superblock->cluster_size);
+    }
 
-        // data to write
-        for (int j = 0; j < dirs_in_cluster; j++) {
-            data[j] = items->data[index];
-            index++;
-            item_size++;
-            if (j + 1 == items->size) {
-                break;
-            }
-        }
+    DIRECTORY_HEADER *header = directory_header(fs, inode);
+    memset(header, 0, sizeof(DIRECTORY_HEADER));
+    header->capacity = capacity;
+}
 
-        fwrite(data, sizeof(DIRECTORY_ITEM), item_size, fs->FILE);
+/**
+ * Vloží položku do tabulky, která na ni má místo.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ * @param name - jméno položky
+ * @param node_id - id i-nodu položky
+ */
+static void directory_put(FS *fs, PSEUDO_INODE *inode, char *name, int32_t node_id) {
+    DIRECTORY_ITEM *item = directory_slot(fs, inode, directory_find_slot(fs, inode, name));
+
+    item->node_id = node_id;
+    strncpy(item->item_name, name, MAX_FILENAME_LENGTH - 1);
+    item->item_name[MAX_FILENAME_LENGTH - 1] = '\0';
+    io_mark_dirty(fs, item, sizeof(DIRECTORY_ITEM));
+
+    DIRECTORY_HEADER *header = directory_header(fs, inode);
+    header->size++;
+    io_mark_dirty(fs, header, sizeof(DIRECTORY_HEADER));
 
-        item_size = 0;
+    inode->file_size = sizeof(DIRECTORY_ITEMS) + header->size * sizeof(DIRECTORY_ITEM);
+    write_inode_to_file(fs, inode);
+}
+
+/**
+ * Zvětší hashovací tabulku adresáře na dvojnásobný počet clusterů a položky do ní znovu rozhází.
+ * Nové clustery se přidávají přes přímé a nepřímé odkazy i-nodu.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ *
+ * @return  true - tabulka byla zvětšena
+ *          false - adresář už nemůže mít více clusterů nebo nejsou volné clustery
+ */
+static bool directory_grow(FS *fs, PSEUDO_INODE *inode) {
+    int32_t n_of_clusters = inode->count_clusters * 2;
+    if (n_of_clusters > inode_max_clusters(fs)) {
+        n_of_clusters = inode_max_clusters(fs);
     }
+    if (n_of_clusters <= inode->count_clusters) {
+        return false;
+    }
+
+    // keep the entries aside, the table is rebuilt over more clusters
+    DIRECTORY_ITEMS *items = read_directory_items_from_file(fs, inode);
 
-    fflush(fs->FILE);
-    if (inode->count_clusters > COUNT_DIRECT_LINK) {
-        printf("Not enough clusters for directory item. \n");
+    // the table is rebuilt over whatever was added, even if the disk fills up meanwhile
+    int32_t old_count = inode->count_clusters;
+    while (inode->count_clusters < n_of_clusters && inode_add_cluster(fs, inode) != -1);
+    if (inode->count_clusters == old_count) {
+        free_directory_items(items);
+        return false;
     }
 
+    write_directory_items_to_file(fs, items, inode);
+    free_directory_items(items);
+
+    return true;
 }
 
 /**
- * Přečte ze souboru file systému strukturu directory_items naplněnou příslušnými soubory a vrátí ji.
+ * Najde položku adresáře podle jména.
  *
  * @param fs - struktura file systému
- * @param inode - i-node directory item, který čteme
+ * @param inode - i-node adresáře
+ * @param name - jméno položky
  *
- * @return přečtené directory_items ze souboru
+ * @return  id i-nodu položky
+ *          -1, pokud adresář položku neobsahuje
  */
-DIRECTORY_ITEMS *read_directory_items_from_file(FS *fs, PSEUDO_INODE *inode) {
-    int index = 0;
+int32_t directory_lookup(FS *fs, PSEUDO_INODE *inode, char *name) {
+    return directory_slot(fs, inode, directory_find_slot(fs, inode, name))->node_id;
+}
 
-    // number of directory items in one cluster
-    int dirs_in_cluster = fs->superblock->cluster_size / sizeof(DIRECTORY_ITEM);
+/**
+ * Vloží položku do adresáře. Při zaplnění tabulky na více než 3/4 se tabulka zvětší.
+ * Jméno musí mít méně než MAX_FILENAME_LENGTH znaků, aby se uložilo celé i s ukončující nulou.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ * @param name - jméno položky
+ * @param node_id - id i-nodu položky
+ *
+ * @return  true - položka byla vložena
+ *          false - položka už existuje, jméno je příliš dlouhé nebo je adresář plný
+ */
+bool directory_insert(FS *fs, PSEUDO_INODE *inode, char *name, int32_t node_id) {
+    // a cut name would be hashed and compared differently than it is stored
+    if (strlen(name) >= MAX_FILENAME_LENGTH) {
+        printf("FILENAME IS TOO LONG\n");
+        return false;
+    }
 
-    DIRECTORY_ITEMS *directory_items = calloc(1, sizeof(DIRECTORY_ITEMS));
+    if (directory_lookup(fs, inode, name) != -1) {
+        return false;
+    }
 
-    fseek(fs->FILE, fs->superblock->data_start_address + inode->directs[0] * fs->superblock->cluster_size, SEEK_SET);
-    fread(directory_items, sizeof(DIRECTORY_ITEMS), 1, fs->FILE);
+    DIRECTORY_HEADER *header = directory_header(fs, inode);
+    if ((header->size + 1) * 4 > header->capacity * 3) {
+        directory_grow(fs, inode);
+        header = directory_header(fs, inode);
+    }
 
-    directory_items->data = calloc(directory_items->size, sizeof(DIRECTORY_ITEM));
-    /*if( directory_items->data  == NULL){
-        printf("Error: nedostatek pameti(2) \n");
-        return NULL;
-    }*/
-    DIRECTORY_ITEM *data = calloc(dirs_in_cluster, sizeof(DIRECTORY_ITEM));
+    // at least one slot has to stay empty, so the probing ends
+    if (header->size + 1 >= header->capacity) {
+        printf("DIRECTORY IS FULL\n");
+        return false;
+    }
 
-    for (int i = 0; i < inode->count_clusters; i++) {
-        if (i == 0) {
-            // v prvnim clusteru je tako DIRECTORY_ITEMS
-            fseek(fs->FILE, fs->superblock->data_start_address + inode->directs[i] * fs->superblock->cluster_size +
-                            sizeof(DIRECTORY_ITEMS), SEEK_SET);
-        } else {
-            // jinak se presunu co jiného clusteru
-            fseek(fs->FILE, fs->superblock->data_start_address + inode->directs[i] * fs->superblock->cluster_size, SEEK_SET);
-        }
+    cache_invalidate_entry(fs, inode->node_id, name);
+    directory_put(fs, inode, name, node_id);
+
+    return true;
+}
+
+/**
+ * Odstraní položku z adresáře. Následující položky stejného řetězce se posunou zpět,
+ * takže v tabulce nezůstávají smazané sloty.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node adresáře
+ * @param name - jméno položky
+ *
+ * @return  true - položka byla odstraněna
+ *          false - adresář položku neobsahuje
+ */
+bool directory_remove(FS *fs, PSEUDO_INODE *inode, char *name) {
+    DIRECTORY_HEADER *header = directory_header(fs, inode);
+    int32_t capacity = header->capacity;
+    int32_t hole = directory_find_slot(fs, inode, name) - 1;
 
-        fread(data, sizeof(DIRECTORY_ITEM), dirs_in_cluster, fs->FILE);
+    if (directory_slot(fs, inode, hole + 1)->node_id == -1) {
+        return false;
+    }
+    cache_invalidate_entry(fs, inode->node_id, name);
+
+    // backward shift deletion
+    int32_t position = hole;
+    while (true) {
+        position = (position + 1) % capacity;
+        DIRECTORY_ITEM *item = directory_slot(fs, inode, position + 1);
+        if (item->node_id == -1) {
+            break;
+        }
 
-        // data to read
-        for (int j = 0; j < directory_items->size; j++) {
-            strcpy(directory_items->data[index].item_name, data[j].item_name);
-            directory_items->data[index].node_id = data[j].node_id;
-            index++;
+        // move the item into the hole if its home slot is not between the hole and its position
+        int32_t home = directory_hash(item->item_name) % capacity;
+        bool stays = hole <= position ? (hole < home && home <= position) : (hole < home || home <= position);
+        if (stays == false) {
+            DIRECTORY_ITEM *hole_item = directory_slot(fs, inode, hole + 1);
+            *hole_item = *item;
+            io_mark_dirty(fs, hole_item, sizeof(DIRECTORY_ITEM));
+            hole = position;
         }
     }
 
-    free(data);
+    DIRECTORY_ITEM *item = directory_slot(fs, inode, hole + 1);
+    item->node_id = -1;
+    memset(item->item_name, 0, MAX_FILENAME_LENGTH);
+    io_mark_dirty(fs, item, sizeof(DIRECTORY_ITEM));
+
+    header->size--;
+    io_mark_dirty(fs, header, sizeof(DIRECTORY_HEADER));
+
+    inode->file_size = sizeof(DIRECTORY_ITEMS) + header->size * sizeof(DIRECTORY_ITEM);
+    write_inode_to_file(fs, inode);
+
+    return true;
+}
+
+/**
+ * Zapíše položky directory_items do hashované tabulky adresáře v souboru FS. Původní obsah tabulky
+ * se přepíše.
+ *
+ * @param fs - struktura file systému
+ * @param items directory_items
+ * @param inode inode příslušného datového bloku
+ */
+void write_directory_items_to_file(FS *fs, DIRECTORY_ITEMS *items, PSEUDO_INODE *inode) {
+    directory_format(fs, inode);
+
+    for (int i = 0; i < items->size; i++) {
+        directory_put(fs, inode, items->data[i].item_name, items->data[i].node_id);
+    }
+}
+
+/**
+ * Přečte ze souboru file systému strukturu directory_items naplněnou příslušnými soubory a vrátí ji.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node directory item, který čteme
+ *
+ * @return přečtené directory_items ze souboru
+ */
+DIRECTORY_ITEMS *read_directory_items_from_file(FS *fs, PSEUDO_INODE *inode) {
+    DIRECTORY_HEADER *header = directory_header(fs, inode);
+
+    DIRECTORY_ITEMS *directory_items = calloc(1, sizeof(DIRECTORY_ITEMS));
+    directory_items->data = calloc(header->size > 0 ? header->size : 1, sizeof(DIRECTORY_ITEM));
+
+    // used slots of the table, in slot order
+    for (int i = 1; i <= header->capacity && directory_items->size < header->size; i++) {
+        DIRECTORY_ITEM *item = directory_slot(fs, inode, i);
+        if (item->node_id != -1) {
+            directory_items->data[directory_items->size] = *item;
+            directory_items->size++;
+        }
+    }
 
     return directory_items;
 }
@@ -225,6 +412,19 @@ static void print_directory_item(DIRECTORY_ITEM *item) {
     printf("%s (node ID: %d)\n", item->item_name, item->node_id);
 }
 
+/**
+ * Vrátí nedokončený soubor - odebere ho z adresáře a uvolní jeho clustery i i-node.
+ *
+ * @param fs - struktura file systému
+ * @param dest_inode - i-node adresáře se souborem
+ * @param filename - jméno souboru
+ * @param inode - i-node souboru
+ */
+static void undo_file_in_FS(FS *fs, PSEUDO_INODE *dest_inode, char *filename, PSEUDO_INODE *inode) {
+    directory_remove(fs, dest_inode, filename);
+    release_inode(fs, inode);
+}
+
 /**
  * Vytvoří soubor ve FS s daty ze souboru source_file.
  *
@@ -236,16 +436,18 @@ static void print_directory_item(DIRECTORY_ITEM *item) {
  *          false - jindy
  */
 bool create_file_in_FS(FS *fs, FILE *source_file, char *filename, PSEUDO_INODE *dest_inode) {
-    // get file size
-    fseek(source_file, 0, SEEK_END);
-    int file_size = ftell(source_file);
-    fseek(source_file, 0, SEEK_SET);
-
-    // reference to destination directory
-    DIRECTORY_ITEMS *dest_directory = read_directory_items_from_file(fs, dest_inode);
+    // get file size, 64-bit even where long is not
+    fseeko(source_file, 0, SEEK_END);
+    off_t file_size = ftello(source_file);
+    fseeko(source_file, 0, SEEK_SET);
+    if (file_size < 0) {
+        printf("CANNOT READ FILE\n");
+        fclose(source_file);
+        return false;
+    }
 
     // does directory already contains file with this name?
-    if (directory_contains_file(dest_directory, filename) == true) {
+    if (directory_lookup(fs, dest_inode, filename) != -1) {
         printf("File or directory '%s' already exists.\n", filename);
         fclose(source_file);
         return false;
@@ -260,107 +462,105 @@ bool create_file_in_FS(FS *fs, FILE *source_file, char *filename, PSEUDO_INODE *
     }
 
     // how many clusters we need
-    int n_of_clusters = 1;
+    int32_t n_of_clusters = 1;
     if (file_size != 0) {
-        n_of_clusters = file_size / fs->superblock->cluster_size;
-        if (file_size % CLUSTER_SIZE != 0) {    // not a full cluster
+        // the file can't be bigger than the whole disk
+        if (file_size / fs->superblock->cluster_size >= fs->superblock->cluster_count) {
+            printf("NOT ENOUGH FREE CLUSTERS\n");
+            fclose(source_file);
+            return false;
+        }
+        n_of_clusters = (int32_t) (file_size / fs->superblock->cluster_size);
+        if (file_size % fs->superblock->cluster_size != 0) {    // not a full cluster
             n_of_clusters++;
         }
     }
 
-    // number of clusters that needs to use indirect links
-    int32_t cluster_overflow = 0;
-    // number of indirect links
-    int32_t n_of_indirects = 0;
-    // how many int32 can go to one cluster
-    int32_t n_of_ints_in_cluster = fs->superblock->cluster_size / sizeof(int32_t);
+    // find free clusters
+    if (find_free_clusters(fs, n_of_clusters) == false) {
+        printf("NOT ENOUGH FREE CLUSTERS\n");
+        fclose(source_file);
+        return false;
+    }
+
+    // extent mode - the file is stored in a few contiguous runs of clusters
+    EXTENT extents[COUNT_EXTENTS];
+    int32_t n_of_extents = get_extents(fs, n_of_clusters, extents);
+    if (n_of_extents != -1) {
+        if (add_item_to_directory(fs, dest_inode, filename, new_inode) == false) {
+            for (int i = 0; i < n_of_extents; i++) {
+                for (int j = 0; j < extents[i].length; j++) {
+                    bitmap_set_free(fs, extents[i].start + j);
+                }
+            }
+            fclose(source_file);
+            return false;
+        }
 
-    if (n_of_clusters > COUNT_DIRECT_LINK) {
-        cluster_overflow = n_of_clusters - COUNT_DIRECT_LINK;
-        n_of_indirects = cluster_overflow / n_of_ints_in_cluster;
-        if (cluster_overflow % n_of_ints_in_cluster != 0) {
-            n_of_indirects++;
+        int32_t no_directs[COUNT_DIRECT_LINK];
+        for (int i = 0; i < COUNT_DIRECT_LINK; i++) {
+            no_directs[i] = -1;
         }
+        new_inode = init_pseudoinode(fs, new_inode->node_id, dest_inode->node_id, false, false, file_size,
+                                     n_of_clusters, no_directs, -1, -1);
+        set_inode_extents(new_inode, extents, n_of_extents);
+
+        // one write per extent
+        if (write_runs_from_file(fs, new_inode, source_file) == false) {
+            printf("CANNOT READ FILE\n");
+            undo_file_in_FS(fs, dest_inode, filename, new_inode);
+            fclose(source_file);
+            return false;
+        }
+
+        fclose(source_file);
+        return true;
     }
 
-    // number of indirect links too big
-    if (n_of_indirects > 2) {
-        printf("FILE IS TOO BIG, NOT ENOUGH INDIRECT LINKS.\n");
+    // the file is too big even for the triple indirect links
+    if (n_of_clusters > inode_max_clusters(fs)) {
+        printf("FILE IS TOO BIG\n");
         fclose(source_file);
         return false;
     }
 
-    // find free clusters
-    if (find_free_clusters(fs, n_of_clusters + n_of_indirects) == false) {
+    // find free clusters, blocks of links included
+    if (find_free_clusters(fs, n_of_clusters + inode_pointer_blocks(fs, n_of_clusters)) == false) {
         printf("NOT ENOUGH FREE CLUSTERS\n");
         fclose(source_file);
         return false;
     }
 
-    int32_t read_size = fs->superblock->cluster_size;
-
     // adds file to the directory
-    add_item_to_directory(fs, dest_directory, dest_inode, filename, new_inode);
-
-    // initialize new i-node
-    int32_t *directs = malloc(sizeof(int32_t)* COUNT_DIRECT_LINK);
-    for (int i = 0; i < COUNT_DIRECT_LINK; i++) {
-        if (i >= n_of_clusters) {
-            directs[i] = -1;
-        } else {
-            directs[i] = get_cluster(fs);
-            fs->bitmap->cluster_free[directs[i]] = false;
-        }
+    if (add_item_to_directory(fs, dest_inode, filename, new_inode) == false) {
+        fclose(source_file);
+        return false;
     }
 
-    int32_t indirect1 = -1;
-    int32_t indirect2 = -1;
-
-    if (n_of_indirects == 1) {
-        indirect1 = get_cluster(fs);
-        fs->bitmap->cluster_free[indirect1] = false;
-    } else if (n_of_indirects == 2) {
-        indirect1 = get_cluster(fs);
-        fs->bitmap->cluster_free[indirect1] = false;
-        indirect2 = get_cluster(fs);
-        fs->bitmap->cluster_free[indirect2] = false;
+    // initialize new i-node, the clusters are linked one by one and blocks of links are allocated on the way
+    int32_t directs[COUNT_DIRECT_LINK];
+    for (int i = 0; i < COUNT_DIRECT_LINK; i++) {
+        directs[i] = -1;
     }
-
-    // initialize new i-node
     new_inode = init_pseudoinode(fs, new_inode->node_id, dest_inode->node_id, false, false, file_size,
-                                 n_of_clusters, directs, indirect1, indirect2);
-
-    // indirect links
-    int32_t data_links[cluster_overflow];
-    for (int j = 0; j < cluster_overflow; j++) {
-        data_links[j] = get_cluster(fs);
-        fs->bitmap->cluster_free[data_links[j]] = false;
-    }
-
-    char **buffer = malloc(n_of_clusters * sizeof(char *));
-    for (int i = 0; i < n_of_clusters; ++i) {
-        buffer[i] = (char *) malloc((fs->superblock->cluster_size + 1) * sizeof(char));
-    }
-
-    // data
-    size_t offset = 0;
-    long actual_size = file_size;
+                                 0, directs, -1, -1);
+    // the directory could have grown since the clusters were counted
     for (int i = 0; i < n_of_clusters; i++) {
-        offset = i * fs->superblock->cluster_size;
-        fseek(source_file, offset, SEEK_SET);
-        fread(buffer[i], sizeof(char), read_size, source_file);
-        if (i == (n_of_clusters - 1)) {
-            buffer[i][actual_size] = '\0';
-        } else {
-            buffer[i][read_size] = '\0';
+        if (inode_add_cluster(fs, new_inode) == -1) {
+            printf("NOT ENOUGH FREE CLUSTERS\n");
+            undo_file_in_FS(fs, dest_inode, filename, new_inode);
+            fclose(source_file);
+            return false;
         }
-        actual_size -= fs->superblock->cluster_size;
     }
 
-    // write changes to file
-    write_clusters_to_file(fs, new_inode, data_links, buffer);
-    write_inodes_to_file(fs);
-    write_bitmap_to_file(fs);
+    // data are streamed from the source file into the clusters
+    if (write_runs_from_file(fs, new_inode, source_file) == false) {
+        printf("CANNOT READ FILE\n");
+        undo_file_in_FS(fs, dest_inode, filename, new_inode);
+        fclose(source_file);
+        return false;
+    }
 
     fclose(source_file);
     return true;
@@ -379,22 +579,16 @@ bool create_file_in_FS(FS *fs, FILE *source_file, char *filename, PSEUDO_INODE *
  */
 bool create_s_link(FS *fs, char *filename, char *linked_file_name, PSEUDO_INODE *dest_inode) {
 
-    // reference to destination directory
-    DIRECTORY_ITEMS *dest_directory = read_directory_items_from_file(fs, dest_inode);
-
     // does directory already contains file with this name?
-    if (directory_contains_file(dest_directory, filename) == true) {
+    if (directory_lookup(fs, dest_inode, filename) != -1) {
         printf("File or directory '%s' already exists.\n", filename);
         return false;
     }
 
     // linked file node ID
-    int32_t linked_file_node_id;
-    for (int i = 0; i < dest_directory->size; ++i) {
-        if (strcmp(dest_directory->data[i].item_name, linked_file_name) == 0) {
-            linked_file_node_id = dest_directory->data[i].node_id;
-            printf("Found node ID %d\n", linked_file_node_id);
-        }
+    int32_t linked_file_node_id = directory_lookup(fs, dest_inode, linked_file_name);
+    if (linked_file_node_id != -1) {
+        printf("Found node ID %d\n", linked_file_node_id);
     }
 
     // get free i-node
@@ -405,12 +599,12 @@ bool create_s_link(FS *fs, char *filename, char *linked_file_name, PSEUDO_INODE
     }
 
     // adds file to the directory
-    add_item_to_directory(fs, dest_directory, dest_inode, filename, new_inode);
-
-    int n_of_clusters = 0;
+    if (add_item_to_directory(fs, dest_inode, filename, new_inode) == false) {
+        return false;
+    }
 
     // initialize new i-node
-    int32_t *directs = malloc(sizeof(int32_t)* COUNT_DIRECT_LINK);
+    int32_t directs[COUNT_DIRECT_LINK];
     for (int i = 0; i < COUNT_DIRECT_LINK; i++) {
             directs[i] = -1;
     }
@@ -418,62 +612,27 @@ bool create_s_link(FS *fs, char *filename, char *linked_file_name, PSEUDO_INODE
     // initialize new i-node
     new_inode = init_slink(fs, new_inode->node_id, dest_inode->node_id, linked_file_node_id, directs);
 
-    // write changes to file
-    //write_clusters_to_file(fs, new_inode, data_links, buffer);
-    write_inodes_to_file(fs);
-    write_bitmap_to_file(fs);
-
     return true;
 
 }
 
 /**
- * Vrátí, zda se soubor se stejným jménem již v adresáři nachází.
- *
- * @param items directory item (adresář), který prohlížíme
- * @param filename jméno souboru
- *
- * @return  true - soubor s tímto jménem již existuje
- *          false - soubor neexistuje
- */
-bool directory_contains_file(DIRECTORY_ITEMS *items, char *filename) {
-    for (int i = 0; i < items->size; ++i) {
-        if (strcmp(items->data[i].item_name, filename) == 0) {
-            return true;
-        }
-    }
-    return false;
-}
-
-/**
- * Přidá item (soubor) do directory item a zapíše jej do souboru FS.
+ * Přidá item (soubor) do adresáře a zapíše jej do souboru FS.
  *
  * @param fs - struktura file systému
- * @param items - directory item, do kterého přidávám nový item
- * @param inode - i-node itemu
+ * @param inode - i-node adresáře
  * @param name - název nového itemu
  * @param new_inode - i-node představující nový item
+ *
+ * @return  true - item byl přidán
+ *          false - item se stejným jménem už existuje nebo je adresář plný
  */
-void add_item_to_directory(FS *fs, DIRECTORY_ITEMS *items, PSEUDO_INODE *inode, char *name, PSEUDO_INODE *new_inode) {
-    fs->FILE = fopen(fs->filename, "rb+");
-
+bool add_item_to_directory(FS *fs, PSEUDO_INODE *inode, char *name, PSEUDO_INODE *new_inode) {
     // set parent id of the new i-node to current i-node
     new_inode->parent_id = inode->node_id;
+    write_inode_to_file(fs, new_inode);
 
-    // increment size
-    items->size = items->size + 1;
-
-    // realloc memory, so there is memory for the new item
-    items->data = realloc(items->data, items->size * sizeof(DIRECTORY_ITEM));
-
-    // copy data
-    strcpy(items->data[items->size - 1].item_name, name);
-    items->data[(items->size - 1)].node_id = new_inode->node_id;
-
-    inode->file_size = sizeof(DIRECTORY_ITEMS) + items->size * sizeof(DIRECTORY_ITEM);
-
-    // write to file
-    write_directory_items_to_file(fs, items, inode);
+    return directory_insert(fs, inode, name, new_inode->node_id);
 }
 
 /**
@@ -482,70 +641,44 @@ void add_item_to_directory(FS *fs, DIRECTORY_ITEMS *items, PSEUDO_INODE *inode,
  * @param items - directory_items k uvolnění
  */
 void free_directory_items(DIRECTORY_ITEMS *items){
+    free(items->data);
     free(items);
 }
 
 /**
- * Vrátí pole odkazů na všechny clustery, ve kterých je zapsán soubor.
+ * Zapíše obsah souboru z pevného disku do clusterů i-nodu, jedním zápisem na každý souvislý úsek.
  *
  * @param fs - struktura file systému
- * @param inode - i-node souboru
+ * @param inode - i-node souboru s přiřazenými clustery
+ * @param source_file - soubor na pevném disku, čte se od začátku
  *
- * @return  pole odkazů na datové bloky
+ * @return  true - data byla zapsána
+ *          false - soubor nelze přečíst nebo je kratší než i-node
  */
-int32_t *get_all_file_clusters(FS *fs, PSEUDO_INODE *inode) {
-    int index = 0;
-
-    // allocation of all file clusters
-    int32_t *file_clusters = (int32_t*)malloc(sizeof(int32_t) * inode->count_clusters);
-
-    // direct links
-    for (int j = 0; j < inode->count_clusters; j++) {
-        if (inode->directs[j] != -1 && j < COUNT_DIRECT_LINK) {   // j + 1 <= COUNT_DIRECT_LINK
-            file_clusters[j] = inode->directs[j];
-            index++;
-        } else {
-            file_clusters[j] = -1;
+bool write_runs_from_file(FS *fs, PSEUDO_INODE *inode, FILE *source_file) {
+    CLUSTER_ITERATOR iterator;
+    EXTENT run;
+    cluster_iterator_init(&iterator, inode);
+    int64_t actual_size = inode->file_size;
+
+    // the source is read sequentially in chunks of at most IO_CHUNK_SIZE, straight into the mapped clusters
+    fseeko(source_file, 0, SEEK_SET);
+    while (actual_size > 0 && cluster_iterator_next_run(fs, &iterator, &run) == true) {
+        size_t bytes = (size_t) run.length * fs->superblock->cluster_size;
+        if (bytes > actual_size) {
+            bytes = actual_size;
         }
-    }
-
-    int32_t *data1 = (int32_t*)malloc(sizeof(int32_t) * inode->count_clusters);
 
-    // first indirect link is used
-    if (inode->indirect1 != -1) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (inode->indirect1 * fs->superblock->cluster_size), SEEK_SET);
-
-        int count = 0;
-        if(inode->indirect2 == -1) {
-            count = (inode->count_clusters - COUNT_DIRECT_LINK);
-        } else {
-            count = fs->superblock->cluster_size / sizeof(int32_t);
-        }
-
-        fread(data1, sizeof(int32_t), count, fs->FILE);
-
-        for (int i = 0; i < count; i++) {
-            file_clusters[index] = data1[i];
-            index++;
-        }
-    }
-
-    // second indirect link is used
-    if (inode->indirect2 != -1) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (inode->indirect2 * fs->superblock->cluster_size), SEEK_SET);
-
-        int32_t count = 0;
-        count = (inode->count_clusters - COUNT_DIRECT_LINK - (fs->superblock->cluster_size / sizeof(int32_t)));
-
-        int32_t data2[count];
-
-        fread(data2, sizeof(int32_t), count, fs->FILE);
-
-        for (int i = 0; i < count; i++) {
-            file_clusters[index] = data2[i];
-            index++;
+        char *cluster = cluster_ptr(fs, run.start);
+        for (size_t offset = 0; offset < bytes; offset += IO_CHUNK_SIZE) {
+            size_t chunk = bytes - offset < IO_CHUNK_SIZE ? bytes - offset : IO_CHUNK_SIZE;
+            if (fread(cluster + offset, sizeof(char), chunk, source_file) != chunk) {
+                return false;
+            }
+            io_mark_data(fs, cluster + offset, chunk);
         }
+        actual_size -= bytes;
     }
 
-    return file_clusters;
+    return actual_size == 0;
 }
\ No newline at end of file
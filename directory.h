@@ -15,13 +15,15 @@ DIRECTORY_ITEMS *read_directory_items_from_file(FS *fs, PSEUDO_INODE *inode);
 void print_directory_items(DIRECTORY_ITEMS *items);
 static void print_directory_item(DIRECTORY_ITEM *item);
 
-bool directory_contains_file(DIRECTORY_ITEMS *items, char *filename);
-void add_item_to_directory(FS *fs, DIRECTORY_ITEMS *items, PSEUDO_INODE *inode, char *name,
-                           PSEUDO_INODE *new_inode);
+uint32_t directory_hash(char *name);
+int32_t directory_lookup(FS *fs, PSEUDO_INODE *inode, char *name);
+bool directory_insert(FS *fs, PSEUDO_INODE *inode, char *name, int32_t node_id);
+bool directory_remove(FS *fs, PSEUDO_INODE *inode, char *name);
+bool add_item_to_directory(FS *fs, PSEUDO_INODE *inode, char *name, PSEUDO_INODE *new_inode);
 
 bool create_file_in_FS(FS *fs, FILE *source_file, char *filename, PSEUDO_INODE *dest_inode);
 void free_directory_items(DIRECTORY_ITEMS *items);
-int32_t *get_all_file_clusters(FS *fs, PSEUDO_INODE *inode);
+bool write_runs_from_file(FS *fs, PSEUDO_INODE *inode, FILE *source_file);
 
 bool create_s_link(FS *fs, char *filename, char *linked_file_name, PSEUDO_INODE *dest_inode);
 
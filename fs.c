@@ -5,10 +5,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
 #include "header.h"
 #include "fs.h"
 #include "inodes.h"
 #include "directory.h"
+#include "io.h"
+#include "cache.h"
+#include "journal.h"
+#include "stats.h"
+#include "arena.h"
 
 /**
  * Inicializuje file systém. V závislosti na tom, zda soubor file systému již existuje, nebo chceme
@@ -20,12 +27,15 @@
  * @param signature jméno uživatele
  * @param descriptor popis systému
  * @param disk_size velikost disku
+ * @param cluster_size velikost clusteru nového FS, načtený FS má svou velikost v superblocku
+ * @param inode_count počet i-nodů, 0 = odvodit z velikosti disku
  * @param format 0 ano, formátovat, 1 ne,
  *
  * @return struktura file systému
  */
-FS *fs_init(char *filename, char *signature, char *descriptor, size_t disk_size, int format) {
-    printf("FS initializing. \n");
+FS *fs_init(char *filename, char *signature, char *descriptor, int64_t disk_size, int32_t cluster_size,
+            int32_t inode_count, int format) {
+    fprintf(stderr, "FS initializing. \n");
 
     // allocation
     FS *fs = calloc(1, sizeof(FS));
@@ -38,26 +48,43 @@ FS *fs_init(char *filename, char *signature, char *descriptor, size_t disk_size,
     fs->actual_path = calloc(PATH_MAX, sizeof(char));
     memset(fs->actual_path, 0, PATH_MAX * sizeof(char));
 
-    // try to open the file with FS
-    FILE *fs_file = fopen(filename, "r+");
+    fs->fd = -1;
 
     // FS doesn't exists yet OR we wanna format the FS
-    if (fs_file == NULL || format == 0) {
-        printf("Formatting the FS\n");
-
-        // create new file
-        fs->FILE = fopen(fs->filename, "wb");
+    if (access(fs->filename, F_OK) != 0 || format == 0) {
+        fprintf(stderr, "Formatting the FS\n");
 
         // initialize superblock
-        SUPERBLOCK *superblock = superblock_init(signature, descriptor, disk_size, CLUSTER_SIZE);
-        fs->superblock = superblock;
+        SUPERBLOCK *superblock = superblock_init(signature, descriptor, disk_size, cluster_size, inode_count);
+        if (superblock == NULL) {
+            printf("Error: Disk is too big for the cluster size.\n");
+            return NULL;
+        }
+
+        // create new file with its full size and map it
+        if (io_open(fs, image_size(superblock), true) == false) {
+            printf("Error creating FS file.\n");
+            free(superblock);
+            return NULL;
+        }
+
+        fs->superblock = (SUPERBLOCK *) io_ptr(fs, 0);
+        memcpy(fs->superblock, superblock, sizeof(SUPERBLOCK));
+        free(superblock);
+
+        // journal of the new image is empty
+        fs->journal_head = 0;
+        fs->journal_sequence = 1;
 
         // initialize bitmap
-        BITMAP *bitmap = bitmap_init(fs->superblock->cluster_count);
+        BITMAP *bitmap = bitmap_init(fs, fs->superblock->bitmap_start_address, fs->superblock->cluster_count);
         fs->bitmap = bitmap;
 
+        // initialize reference counts of clusters
+        fs->refcounts = refcounts_init(fs, fs->superblock->cluster_count);
+
         // initialize inodes
-        INODES *inodes = inodes_init(fs->superblock->inode_count);
+        INODES *inodes = inodes_init(fs, fs->superblock->inode_count);
         fs->inodes = inodes;
 
         // create FS file with the basic structure
@@ -65,28 +92,29 @@ FS *fs_init(char *filename, char *signature, char *descriptor, size_t disk_size,
 
     } else {
         // loading already existing FS
-        fclose(fs_file);
-        printf("File system file (%s) found, loading.\n", filename);
+        fprintf(stderr, "File system file (%s) found, loading.\n", filename);
 
-        fs->FILE = fopen(fs->filename, "rb+");
-
-        if (fs->FILE == NULL) {
+        if (io_open(fs, 0, false) == false) {
             printf("Error: File system file does not exist.\n");
             return NULL;
         }
 
         // load fs from file
-        load_fs_from_file(fs);
+        if (load_fs_from_file(fs) == false) {
+            printf("Error: Not a file system image of a supported version, the file was left as it is.\n");
+            io_close(fs);
+            return NULL;
+        }
 
         INODES *inodes = fs->inodes;
         fs->current_inode = &inodes->data[0];
-
-        DIRECTORY_ITEMS *root_directory = read_directory_items_from_file(fs, fs->current_inode);
-        fs->current_directory = root_directory;
     }
 
-    update_current_directory(fs);
-    print_fs(fs);
+    // lookups are cached from the first command on
+    fs->cache = cache_init(fs->superblock->inode_count);
+
+    // the new image is written right away
+    io_flush(fs);
 
     return fs;
 }
@@ -95,14 +123,48 @@ FS *fs_init(char *filename, char *signature, char *descriptor, size_t disk_size,
  * Načte file systém ze souboru.
  *
  * @param fs - struktura file systému
+ *
+ * @return  true - FS je načtený
+ *          false - soubor neobsahuje FS podporované verze
  */
-void load_fs_from_file(FS *fs) {
-    read_sb_from_file(fs);
+bool load_fs_from_file(FS *fs) {
+    if (read_sb_from_file(fs) == false) {
+        return false;
+    }
+
+    // image was not created with its full size
+    if (fs->map_size < image_size(fs->superblock)) {
+        io_resize(fs, image_size(fs->superblock));
+        read_sb_from_file(fs);
+    }
+
+    // changes of the last command that may not have reached their place before a crash
+    int32_t sequence = journal_replay(fs);
+    if (sequence > 0) {
+        fprintf(stderr, "Journal transaction %d replayed.\n", sequence);
+    }
+
     read_bitmap_from_file(fs);
+    read_refcounts_from_file(fs);
     read_inodes_from_file(fs);
 
     /*INODES *inodes = fs->inodes;
     fs->current_inode = &inodes->data[0];*/
+    return true;
+}
+
+/**
+ * Vrátí, zda lze FS naformátovat s danou velikostí clusteru (mocnina dvou od CLUSTER_SIZE_MIN
+ * do CLUSTER_SIZE_MAX, clustery jsou pak zarovnané na stránky i sektory disku).
+ *
+ * @param cluster_size - velikost clusteru
+ *
+ * @return  true - velikost je platná
+ *          false - jinak
+ */
+bool is_cluster_size_valid(int32_t cluster_size) {
+    return cluster_size >= CLUSTER_SIZE_MIN && cluster_size <= CLUSTER_SIZE_MAX &&
+           (cluster_size & (cluster_size - 1)) == 0;
 }
 
 /**
@@ -111,13 +173,23 @@ void load_fs_from_file(FS *fs) {
  * @param signature - jméno uživatele
  * @param volume_descriptor - popis systému
  * @param disk_size - velikost disku
- * @param cluster_size - počet datových bloků
+ * @param cluster_size - velikost clusteru
+ * @param inode_count - počet i-nodů, 0 = jeden i-node na BYTES_PER_INODE bajtů disku
  *
- * @return struktura superblocku
+ * @return  struktura superblocku
+ *          NULL, pokud by počet clusterů nebo i-nodů přesáhl int32_t
  */
-SUPERBLOCK *superblock_init(char *signature, char *volume_descriptor, int32_t disk_size, int32_t cluster_size) {
+SUPERBLOCK *superblock_init(char *signature, char *volume_descriptor, int64_t disk_size, int32_t cluster_size,
+                            int32_t inode_count) {
+    // clusters and i-nodes are still numbered by int32_t
+    if (disk_size / cluster_size >= INT32_MAX || (inode_count <= 0 && disk_size / BYTES_PER_INODE > INT32_MAX)) {
+        return NULL;
+    }
+
     // allocation
     SUPERBLOCK *superblock = calloc(1, sizeof(SUPERBLOCK));
+    superblock->magic = SUPERBLOCK_MAGIC;
+    superblock->version = SUPERBLOCK_VERSION;
 
     // signature
     strcpy(superblock->signature, signature);
@@ -126,55 +198,336 @@ SUPERBLOCK *superblock_init(char *signature, char *volume_descriptor, int32_t di
     strcpy(superblock->volume_descriptor, volume_descriptor);
 
     // set attributes of superblock
-    superblock->inode_count = INODES_COUNT;
+    if (inode_count <= 0) {
+        inode_count = (int32_t) (disk_size / BYTES_PER_INODE);
+        if (inode_count < INODES_MIN_COUNT) {
+            inode_count = INODES_MIN_COUNT;
+        }
+    }
+    superblock->inode_count = inode_count;
     superblock->disk_size = disk_size;
     superblock->cluster_size = cluster_size;
-    superblock->cluster_count = disk_size / cluster_size;       // cluster count = disk size / cluster size
+    superblock->cluster_count = (int32_t) (disk_size / cluster_size);       // cluster count = disk size / cluster size
 
     if (disk_size % cluster_size != 0) superblock->cluster_count++;
 
     // bitmap start address after superblock
-    superblock->bitmap_start_address = sizeof(SUPERBLOCK);
+    superblock->bitmap_start_address = ALIGN_UP(sizeof(SUPERBLOCK), STRUCT_ALIGNMENT);
+
+    // reference counts after bitmap
+    superblock->refcount_start_address = ALIGN_UP(superblock->bitmap_start_address + sizeof(BITMAP) +
+                                                  (BITMAP_WORDS(superblock->cluster_count) * sizeof(uint64_t)),
+                                                  STRUCT_ALIGNMENT);
+
+    // free i-node bitmap after reference counts
+    superblock->inode_bitmap_start_address = ALIGN_UP(superblock->refcount_start_address +
+                                                      (int64_t) superblock->cluster_count * sizeof(uint16_t),
+                                                      STRUCT_ALIGNMENT);
 
-    // inode start address after bitmap
-    superblock->inode_start_address = (superblock->bitmap_start_address + sizeof(BITMAP) + (superblock->cluster_count * sizeof(bool)));
+    // inode start address after free i-node bitmap
+    superblock->inode_start_address = ALIGN_UP(superblock->inode_bitmap_start_address + sizeof(BITMAP) +
+                                               (BITMAP_WORDS(superblock->inode_count) * sizeof(uint64_t)),
+                                               STRUCT_ALIGNMENT);
 
-    // data start address after inodes
-    superblock->data_start_address = (superblock->inode_start_address + sizeof(INODES));
+    // metadata journal after inodes
+    superblock->journal_start_address = ALIGN_UP(superblock->inode_start_address + sizeof(INODES) +
+                                                 (size_t) superblock->inode_count * sizeof(PSEUDO_INODE),
+                                                 JOURNAL_ALIGNMENT);
+    superblock->journal_size = journal_size(disk_size);
+
+    // data start address after journal, every cluster starts at a multiple of its size in the file
+    superblock->data_start_address = ALIGN_UP(superblock->journal_start_address + superblock->journal_size,
+                                              cluster_size);
 
     return superblock;
 }
 
 /**
- * Inicializuje strukturu bitmapy.
+ * Inicializuje strukturu bitmapy v namapovaném souboru FS. Stejná struktura slouží pro clustery
+ * i pro volné i-nody.
  *
- * @param cluster_count počet datových bloků
+ * @param fs - struktura file systému
+ * @param address - adresa bitmapy v souboru FS
+ * @param count počet položek (datových bloků nebo i-nodů)
  *
  * @return struktura bitmapy
  */
-BITMAP *bitmap_init(int32_t cluster_count) {
-    // allocation
-    BITMAP *bitmap = calloc(1, sizeof(BITMAP));
+BITMAP *bitmap_init(FS *fs, int64_t address, int32_t count) {
+    BITMAP *bitmap = (BITMAP *) io_ptr(fs, address);
 
     // bitmap size
-    bitmap->size = cluster_count;
-
-    // allocation of array of bools and set to true (free)
-    bitmap->cluster_free = calloc(bitmap->size, sizeof(bool));
-    memset(bitmap->cluster_free, true, bitmap->size);
+    bitmap->size = count;
+    bitmap->free_count = count;
+    bitmap->next_hint = 0;
+
+    // packed words, everything is free
+    int32_t n_of_words = BITMAP_WORDS(bitmap->size);
+    bitmap->words = (uint64_t *) io_ptr(fs, address + sizeof(BITMAP));
+    memset(bitmap->words, 0xFF, n_of_words * sizeof(uint64_t));
+
+    // bits behind the last item are never free
+    if (bitmap->size % BITMAP_WORD_BITS != 0) {
+        bitmap->words[n_of_words - 1] = (UINT64_C(1) << (bitmap->size % BITMAP_WORD_BITS)) - 1;
+    }
 
     return bitmap;
 }
 
+/**
+ * Vrátí, zda je cluster volný.
+ *
+ * @param bitmap - struktura bitmapy
+ * @param cluster - index clusteru
+ *
+ * @return  true - cluster je volný
+ *          false - cluster je obsazený
+ */
+bool bitmap_is_free(BITMAP *bitmap, int32_t cluster) {
+    return (bitmap->words[cluster / BITMAP_WORD_BITS] >> (cluster % BITMAP_WORD_BITS)) & 1;
+}
+
+/**
+ * Nastaví položku bitmapy jako volnou nebo obsazenou. Do souboru se zapíše jen změněné slovo bitmapy.
+ *
+ * @param fs - struktura file systému
+ * @param bitmap - struktura bitmapy
+ * @param index - index položky
+ * @param is_free - true = volná, false = obsazená
+ */
+void bitmap_set(FS *fs, BITMAP *bitmap, int32_t index, bool is_free) {
+    uint64_t mask = UINT64_C(1) << (index % BITMAP_WORD_BITS);
+    uint64_t *word = &bitmap->words[index / BITMAP_WORD_BITS];
+
+    if (((*word & mask) != 0) == is_free) {
+        return;
+    }
+
+    if (is_free == true) {
+        *word |= mask;
+        bitmap->free_count++;
+    } else {
+        *word &= ~mask;
+        bitmap->free_count--;
+    }
+    io_mark_dirty(fs, word, sizeof(uint64_t));
+    io_mark_dirty(fs, bitmap, sizeof(BITMAP));
+}
+
+/**
+ * Označí cluster jako obsazený.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index clusteru
+ */
+void bitmap_set_used(FS *fs, int32_t cluster) {
+    bitmap_set(fs, fs->bitmap, cluster, false);
+    io_mark_freed(fs, cluster, false);
+    stats.io.clusters_allocated++;
+}
+
+/**
+ * Označí cluster jako volný.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index clusteru
+ */
+void bitmap_set_free(FS *fs, int32_t cluster) {
+    bitmap_set(fs, fs->bitmap, cluster, true);
+    io_mark_freed(fs, cluster, true);
+    stats.io.clusters_freed++;
+}
+
+/**
+ * Najde volnou položku bitmapy, ale neoznačí ji. Hledání začíná od slova bitmapy, kde skončilo
+ * poslední hledání (next fit), a prochází bitmapu po 64bitových slovech.
+ *
+ * @param bitmap - struktura bitmapy
+ *
+ * @return  index volné položky
+ *          -1, pokud volná položka neexistuje
+ */
+int32_t bitmap_find_free(BITMAP *bitmap) {
+    int32_t n_of_words = BITMAP_WORDS(bitmap->size);
+
+    if (bitmap->free_count > 0) {
+        for (int i = 0; i < n_of_words; ++i) {
+            int32_t word_index = (bitmap->next_hint + i) % n_of_words;
+            uint64_t word = bitmap->words[word_index];
+
+            if (word != 0) {
+                bitmap->next_hint = word_index;
+                return word_index * BITMAP_WORD_BITS + __builtin_ctzll(word);
+            }
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Najde první souvislý úsek volných clusterů, který začíná na indexu from nebo za ním.
+ *
+ * @param bitmap - struktura bitmapy
+ * @param from - index clusteru, od kterého hledáme
+ * @param length - výstup, délka nalezeného úseku
+ *
+ * @return  index prvního clusteru úseku
+ *          -1, pokud za indexem from už žádný volný cluster není
+ */
+int32_t bitmap_find_run(BITMAP *bitmap, int32_t from, int32_t *length) {
+    int32_t n_of_words = BITMAP_WORDS(bitmap->size);
+
+    if (from < 0 || from >= bitmap->size) {
+        return -1;
+    }
+
+    // first free bit at or after from
+    int32_t word_index = from / BITMAP_WORD_BITS;
+    uint64_t word = bitmap->words[word_index] & (~UINT64_C(0) << (from % BITMAP_WORD_BITS));
+    while (word == 0) {
+        word_index++;
+        if (word_index >= n_of_words) {
+            return -1;
+        }
+        word = bitmap->words[word_index];
+    }
+    int32_t start = word_index * BITMAP_WORD_BITS + __builtin_ctzll(word);
+
+    // first used bit after start
+    uint64_t used = ~bitmap->words[word_index] & (~UINT64_C(0) << (start % BITMAP_WORD_BITS));
+    while (used == 0) {
+        word_index++;
+        if (word_index >= n_of_words) {
+            *length = bitmap->size - start;
+            return start;
+        }
+        used = ~bitmap->words[word_index];
+    }
+    int32_t end = word_index * BITMAP_WORD_BITS + __builtin_ctzll(used);
+
+    *length = (end < bitmap->size ? end : bitmap->size) - start;
+    return start;
+}
+
+/**
+ * Spočítá volné clustery v bitmapě.
+ *
+ * @param bitmap - struktura bitmapy
+ *
+ * @return počet volných clusterů
+ */
+int32_t bitmap_count_free(BITMAP *bitmap) {
+    int32_t count = 0;
+    for (int i = 0; i < BITMAP_WORDS(bitmap->size); ++i) {
+        count += __builtin_popcountll(bitmap->words[i]);
+    }
+    return count;
+}
+
+/**
+ * Inicializuje tabulku referencí clusterů v namapovaném souboru FS.
+ *
+ * @param fs - struktura file systému
+ * @param cluster_count počet datových bloků
+ *
+ * @return tabulka referencí, jedna položka na cluster
+ */
+uint16_t *refcounts_init(FS *fs, int32_t cluster_count) {
+    // table lives in the mapped file right after the bitmap, no cluster is shared yet
+    uint16_t *refcounts = (uint16_t *) io_ptr(fs, fs->superblock->refcount_start_address);
+    memset(refcounts, 0, cluster_count * sizeof(uint16_t));
+
+    return refcounts;
+}
+
+/**
+ * Přidá clusteru další odkaz (cluster bude sdílený více i-nody).
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index clusteru
+ *
+ * @return  true - odkaz byl přidán
+ *          false - cluster už má maximální počet odkazů
+ */
+bool cluster_ref(FS *fs, int32_t cluster) {
+    if (fs->refcounts[cluster] == UINT16_MAX) {
+        return false;
+    }
+
+    fs->refcounts[cluster]++;
+    io_mark_dirty(fs, &fs->refcounts[cluster], sizeof(uint16_t));
+    return true;
+}
+
+/**
+ * Odebere clusteru jeden odkaz. Cluster se uvolní v bitmapě, až když ho nepoužívá žádný i-node.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index clusteru
+ *
+ * @return  true - cluster byl uvolněn
+ *          false - cluster dál používá jiný i-node
+ */
+bool cluster_unref(FS *fs, int32_t cluster) {
+    if (fs->refcounts[cluster] > 0) {
+        fs->refcounts[cluster]--;
+        io_mark_dirty(fs, &fs->refcounts[cluster], sizeof(uint16_t));
+        return false;
+    }
+
+    bitmap_set_free(fs, cluster);
+    return true;
+}
+
+/**
+ * Vrátí, zda cluster sdílí více i-nodů.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index clusteru
+ *
+ * @return  true - cluster je sdílený
+ *          false - cluster má jediného vlastníka
+ */
+bool cluster_is_shared(FS *fs, int32_t cluster) {
+    return fs->refcounts[cluster] > 0;
+}
+
+/**
+ * Copy-on-write: před zápisem do sdíleného clusteru vytvoří jeho soukromou kopii.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index clusteru, do kterého se bude zapisovat
+ *
+ * @return  index clusteru, do kterého lze zapisovat (původní, pokud sdílený nebyl)
+ *          -1, pokud není volný cluster pro kopii
+ */
+int32_t cluster_make_private(FS *fs, int32_t cluster) {
+    if (cluster_is_shared(fs, cluster) == false) {
+        return cluster;
+    }
+
+    int32_t copy = get_cluster(fs);
+    if (copy == -1) {
+        return -1;
+    }
+
+    memcpy(cluster_ptr(fs, copy), cluster_ptr(fs, cluster), fs->superblock->cluster_size);
+    io_mark_data(fs, cluster_ptr(fs, copy), fs->superblock->cluster_size);
+    fs->refcounts[cluster]--;
+    io_mark_dirty(fs, &fs->refcounts[cluster], sizeof(uint16_t));
+
+    return copy;
+}
+
 /**
  * Zapíše do souboru file systému základní struktury FS.
  *
  * @param fs - struktura file systému
  */
 void create_file(FS *fs) {
-    printf("Creating file.\n");
+    fprintf(stderr, "Creating file.\n");
 
-    if (fs->FILE == NULL) {
+    if (fs->map == NULL) {
         printf("Error creating FS file.\n");
         return;
     } else {
@@ -182,14 +535,15 @@ void create_file(FS *fs) {
         PSEUDO_INODE *inode_root = get_free_inode(fs);      // find free i-node
         DIRECTORY_ITEMS *directory_root = create_directory_item(fs, inode_root->node_id, inode_root, "ROOT");
         fs->current_inode = inode_root;
-        fs->current_directory = directory_root;
 
         // write FS structures to the file
         write_superblock_to_file(fs);
         write_bitmap_to_file(fs);
+        write_refcounts_to_file(fs);
         write_inodes_to_file(fs);
         // write ROOT
         write_directory_items_to_file(fs, directory_root, inode_root);
+        free_directory_items(directory_root);
     }
 }
 
@@ -199,35 +553,26 @@ void create_file(FS *fs) {
  * @param fs - struktura file systému
  */
 void write_superblock_to_file(FS *fs) {
-    fseek(fs->FILE, 0, SEEK_SET);
-    fwrite(fs->superblock, sizeof(SUPERBLOCK), 1, fs->FILE);
-    fflush(fs->FILE);
+    io_mark_dirty(fs, fs->superblock, sizeof(SUPERBLOCK));
 }
 
 /**
- * Zapíše strukturu bitmapy do souboru file systému.
+ * Zapíše celou strukturu bitmapy do souboru file systému. Jednotlivé změny zapisují
+ * bitmap_set_used a bitmap_set_free, celá bitmapa se zapisuje jen při formátování.
  *
  * @param fs - struktura file systému
  */
 void write_bitmap_to_file(FS *fs) {
-    fseek(fs->FILE, fs->superblock->bitmap_start_address, SEEK_SET);
-    fwrite(fs->bitmap, sizeof(BITMAP), 1, fs->FILE);
-    fflush(fs->FILE);
-
-    fseek(fs->FILE, fs->superblock->bitmap_start_address + sizeof(BITMAP), SEEK_SET);
-    fwrite(fs->bitmap->cluster_free, sizeof(bool), fs->bitmap->size, fs->FILE);
-    fflush(fs->FILE);
+    io_mark_dirty(fs, fs->bitmap, sizeof(BITMAP) + BITMAP_WORDS(fs->bitmap->size) * sizeof(uint64_t));
 }
 
 /**
- * Přečte obsah aktuálního adresáře ze souboru file systému a nastaví ho jako obsah aktuálního adresáře.
+ * Zapíše celou tabulku referencí clusterů do souboru file systému (při formátování).
  *
  * @param fs - struktura file systému
  */
-void update_current_directory(FS *fs) {
-    // read items in this directory from file
-    DIRECTORY_ITEMS *items = read_directory_items_from_file(fs, fs->current_inode);
-    fs->current_directory = items;
+void write_refcounts_to_file(FS *fs) {
+    io_mark_dirty(fs, fs->refcounts, fs->superblock->cluster_count * sizeof(uint16_t));
 }
 
 /**
@@ -240,10 +585,11 @@ void print_fs(FS *fs) {
     printf("Current path: %s:%s%s%s \n", fs->superblock->signature, ROOT_CHAR, fs->actual_path, SHELL_CHAR);
     printf("Current i-node id: %d \n", fs->current_inode->node_id);
     printf("Current directory: \n");
-    print_directory_items(fs->current_directory);
+    print_directory_items(cache_get_directory(fs, fs->current_inode));
     print_superblock(fs->superblock);
     print_bitmap(fs->bitmap);
     print_inodes(fs->inodes);
+    print_cache(fs->cache);
     printf("\n");
 }
 
@@ -256,13 +602,19 @@ void print_superblock(SUPERBLOCK *superblock) {
     printf("--- SUPERBLOCK --- \n");
     printf("Signature: %s\n", superblock->signature);
     printf("Volume descriptor: %s\n", superblock->volume_descriptor);
-    printf("Disk size: %dB (%dKB) (%dMB)\n", superblock->disk_size, superblock->disk_size / 1000, superblock->disk_size / 1000000);
+    printf("Version: %u\n", superblock->version);
+    printf("Disk size: %" PRId64 "B (%" PRId64 "KB) (%" PRId64 "MB)\n", superblock->disk_size,
+           superblock->disk_size / 1000, superblock->disk_size / 1000000);
     printf("Cluster size: %dB\n", superblock->cluster_size);
     printf("Cluster count: %d\n", superblock->cluster_count);
     printf("INODES count: %d\n", superblock->inode_count);
-    printf("Bitmap start address: %d\n", superblock->bitmap_start_address);
-    printf("INODE start address: %d\n", superblock->inode_start_address);
-    printf("Data start address: %d\n", superblock->data_start_address);
+    printf("Bitmap start address: %" PRId64 "\n", superblock->bitmap_start_address);
+    printf("Refcount start address: %" PRId64 "\n", superblock->refcount_start_address);
+    printf("INODE bitmap start address: %" PRId64 "\n", superblock->inode_bitmap_start_address);
+    printf("INODE start address: %" PRId64 "\n", superblock->inode_start_address);
+    printf("Journal start address: %" PRId64 " (%" PRId64 "B)\n", superblock->journal_start_address,
+           superblock->journal_size);
+    printf("Data start address: %" PRId64 "\n", superblock->data_start_address);
     printf("\n");
 }
 
@@ -274,11 +626,11 @@ void print_superblock(SUPERBLOCK *superblock) {
 void print_bitmap(BITMAP *bitmap) {
     printf("--- BITMAP ---\n");
     printf("Bitmap size: %d\n", bitmap->size);
+    printf("Free clusters: %d\n", bitmap->free_count);
     for (int i = 0; i < bitmap->size; ++i) {
-        if (bitmap->cluster_free[i] == true) {
+        if (bitmap_is_free(bitmap, i) == true) {
             printf("[%d - free], ", i);
-        }
-        if (bitmap->cluster_free[i] == false) {
+        } else {
             printf("[%d - not free], ", i);
         }
     }
@@ -286,48 +638,164 @@ void print_bitmap(BITMAP *bitmap) {
 }
 
 /**
- * Přečte strukturu superblock ze souboru file systému.
+ * Ověří rozložení obrazu podle superblocku - platnou velikost clusteru, počty odpovídající velikosti
+ * disku, oblasti jdoucí vzestupně za sebou s místem pro své struktury a žurnál velikosti podle disku.
  *
- * @param fs - struktura file systému
+ * @param superblock - superblock obrazu
+ * @param header_size - velikost superblocku v souboru
+ * @param file_size - velikost souboru FS
+ * @param exact - soubor musí mít přesně velikost obrazu, jinak stačí, že v něm začínají data
+ *
+ * @return  true - rozložení je platné
+ *          false - superblock nepopisuje tento soubor
  */
-void read_sb_from_file(FS *fs) {
-    // superblock exists -> free and set to null
-    if (fs->superblock != NULL) {
-        free(fs->superblock);
-        fs->superblock = NULL;
+static bool superblock_is_valid(SUPERBLOCK *superblock, int64_t header_size, int64_t file_size, bool exact) {
+    if (is_cluster_size_valid(superblock->cluster_size) == false || superblock->disk_size <= 0 ||
+        superblock->inode_count <= 0 ||
+        superblock->cluster_count != ALIGN_UP(superblock->disk_size, superblock->cluster_size) /
+                                     superblock->cluster_size) {
+        return false;
     }
 
-    SUPERBLOCK *sb = calloc(1, sizeof(SUPERBLOCK));
-    fseek(fs->FILE, 0, SEEK_SET);
-    fread(sb, sizeof(SUPERBLOCK), 1, fs->FILE);
+    // every region starts inside the file behind the end of the previous one
+    int64_t ends[] = {
+            header_size,
+            superblock->bitmap_start_address + (int64_t) sizeof(BITMAP) +
+            (int64_t) BITMAP_WORDS(superblock->cluster_count) * (int64_t) sizeof(uint64_t),
+            superblock->refcount_start_address + (int64_t) superblock->cluster_count * (int64_t) sizeof(uint16_t),
+            superblock->inode_bitmap_start_address + (int64_t) sizeof(BITMAP) +
+            (int64_t) BITMAP_WORDS(superblock->inode_count) * (int64_t) sizeof(uint64_t),
+            superblock->inode_start_address + (int64_t) sizeof(INODES) +
+            (int64_t) superblock->inode_count * (int64_t) sizeof(PSEUDO_INODE),
+            superblock->journal_start_address + superblock->journal_size
+    };
+    int64_t starts[] = {
+            superblock->bitmap_start_address,
+            superblock->refcount_start_address,
+            superblock->inode_bitmap_start_address,
+            superblock->inode_start_address,
+            superblock->journal_start_address,
+            superblock->data_start_address
+    };
+    for (int i = 0; i < (int) (sizeof(starts) / sizeof(starts[0])); i++) {
+        if (starts[i] < 0 || starts[i] > file_size || starts[i] < ends[i]) {
+            return false;
+        }
+    }
 
-    fs->superblock = sb;
+    if (superblock->journal_size != journal_size(superblock->disk_size) ||
+        superblock->journal_start_address % JOURNAL_ALIGNMENT != 0 ||
+        superblock->data_start_address % superblock->cluster_size != 0) {
+        return false;
+    }
+
+    int64_t size = superblock->data_start_address +
+                   (int64_t) superblock->cluster_count * superblock->cluster_size;
+    return exact == false || size == file_size;
 }
 
 /**
- * Přečte strukturu bitmapy ze souboru file systému.
+ * Přečte strukturu superblock ze souboru file systému. Obraz verze 1 (bez SUPERBLOCK_MAGIC) zůstává
+ * beze změny, jen jeho 32bitový superblock se převede do paměti (fs->converted_superblock).
+ * Za verzi 1 se považují jen obrazy s rozložením verze 1, které přesně odpovídá velikosti souboru -
+ * obrazy původního formátu (bez žurnálu a počtů referencí) se odmítnou a soubor zůstane beze změny.
  *
  * @param fs - struktura file systému
+ *
+ * @return  true - superblock je načtený
+ *          false - soubor není obraz podporované verze nebo je poškozený
  */
-void read_bitmap_from_file(FS *fs) {
-    // bitmap exists -> free and set to null
-    if (fs->bitmap != NULL) {
-        free(fs->bitmap);
-        fs->bitmap = NULL;
+bool read_sb_from_file(FS *fs) {
+    SUPERBLOCK *superblock = (SUPERBLOCK *) io_ptr(fs, 0);
+
+    free(fs->converted_superblock);
+    fs->converted_superblock = NULL;
+    fs->superblock = NULL;
+
+    if (fs->map_size >= sizeof(SUPERBLOCK) && superblock->magic == SUPERBLOCK_MAGIC) {
+        if (superblock->version > SUPERBLOCK_VERSION ||
+            superblock_is_valid(superblock, sizeof(SUPERBLOCK), fs->map_size, false) == false) {
+            return false;
+        }
+        fs->superblock = superblock;
+        return true;
+    }
+    if (fs->map_size < sizeof(SUPERBLOCK_V1)) {
+        return false;
     }
 
-    BITMAP *bitmap = calloc(1, sizeof(BITMAP));
+    // version 1 - the same layout with 32-bit sizes and addresses
+    SUPERBLOCK_V1 *legacy = (SUPERBLOCK_V1 *) superblock;
+    SUPERBLOCK *converted = calloc(1, sizeof(SUPERBLOCK));
+    if (converted == NULL) {
+        return false;
+    }
+    memcpy(converted->signature, legacy->signature, sizeof(converted->signature));
+    memcpy(converted->volume_descriptor, legacy->volume_descriptor, sizeof(converted->volume_descriptor));
+    converted->magic = SUPERBLOCK_MAGIC;
+    converted->version = 1;
+    converted->disk_size = legacy->disk_size;
+    converted->cluster_size = legacy->cluster_size;
+    converted->cluster_count = legacy->cluster_count;
+    converted->inode_count = legacy->inode_count;
+    converted->bitmap_start_address = legacy->bitmap_start_address;
+    converted->refcount_start_address = legacy->refcount_start_address;
+    converted->inode_bitmap_start_address = legacy->inode_bitmap_start_address;
+    converted->inode_start_address = legacy->inode_start_address;
+    converted->journal_start_address = legacy->journal_start_address;
+    converted->journal_size = legacy->journal_size;
+    converted->data_start_address = legacy->data_start_address;
+
+    // images of version 1 were always created with their full size
+    if (superblock_is_valid(converted, sizeof(SUPERBLOCK_V1), fs->map_size, true) == false) {
+        free(converted);
+        return false;
+    }
 
-    // read bitmap structure
-    fseek(fs->FILE, fs->superblock->bitmap_start_address, SEEK_SET);
-    fread(bitmap, sizeof(BITMAP), 1, fs->FILE);
+    fs->converted_superblock = converted;
+    fs->superblock = converted;
+    return true;
+}
 
-    // read clusters
-    bitmap->cluster_free = calloc(bitmap->size, sizeof(bool));
-    fseek(fs->FILE, fs->superblock->bitmap_start_address + sizeof(BITMAP), SEEK_SET);
-    fread(bitmap->cluster_free, bitmap->size * sizeof(bool), 1, fs->FILE);
+/**
+ * Načte bitmapu z namapovaného souboru FS.
+ *
+ * @param fs - struktura file systému
+ * @param address - adresa bitmapy v souboru FS
+ *
+ * @return struktura bitmapy
+ */
+BITMAP *bitmap_load(FS *fs, int64_t address) {
+    BITMAP *bitmap = (BITMAP *) io_ptr(fs, address);
+
+    // words follow the bitmap structure
+    bitmap->words = (uint64_t *) io_ptr(fs, address + sizeof(BITMAP));
+
+    // counter is derived from the words, so it can't drift from the bitmap
+    bitmap->free_count = bitmap_count_free(bitmap);
+    if (bitmap->next_hint < 0 || bitmap->next_hint >= BITMAP_WORDS(bitmap->size)) {
+        bitmap->next_hint = 0;
+    }
+
+    return bitmap;
+}
 
-    fs->bitmap = bitmap;
+/**
+ * Přečte strukturu bitmapy ze souboru file systému.
+ *
+ * @param fs - struktura file systému
+ */
+void read_bitmap_from_file(FS *fs) {
+    fs->bitmap = bitmap_load(fs, fs->superblock->bitmap_start_address);
+}
+
+/**
+ * Přečte tabulku referencí clusterů ze souboru file systému.
+ *
+ * @param fs - struktura file systému
+ */
+void read_refcounts_from_file(FS *fs) {
+    fs->refcounts = (uint16_t *) io_ptr(fs, fs->superblock->refcount_start_address);
 }
 
 /**
@@ -355,13 +823,13 @@ void set_path_to_root(FS *fs) {
 }
 
 /**
- * Vrátí absolutní cestu k souboru.
+ * Vrátí absolutní cestu k souboru. Cesta je v areně příkazu, po jeho skončení neplatí.
  *
  * @param fs - struktura file systému
  * @param path - relativní cesta
  */
 char *get_absolute_path(FS *fs, char *path) {
-    char *temp_path = calloc(PATH_MAX, sizeof(char));
+    char *temp_path = arena_alloc(PATH_MAX);
 
     if (strlen(path) > 0 && path[strlen(path) - 1] == '\n'){
         path[strlen(path) - 1] = '\0';
@@ -6,17 +6,34 @@
 #define ZOS_FS_H
 
 
-FS *fs_init(char *filename, char *signature, char *descriptor, size_t disk_size, int format);
+FS *fs_init(char *filename, char *signature, char *descriptor, int64_t disk_size, int32_t cluster_size,
+            int32_t inode_count, int format);
 void create_file(FS *fs);
-void load_fs_from_file(FS *fs);
-SUPERBLOCK *superblock_init(char *signature, char *volume_descriptor, int32_t disk_size, int32_t cluster_size);
-BITMAP *bitmap_init(int32_t cluster_count);
+bool load_fs_from_file(FS *fs);
+bool is_cluster_size_valid(int32_t cluster_size);
+SUPERBLOCK *superblock_init(char *signature, char *volume_descriptor, int64_t disk_size, int32_t cluster_size,
+                            int32_t inode_count);
+BITMAP *bitmap_init(FS *fs, int64_t address, int32_t count);
+BITMAP *bitmap_load(FS *fs, int64_t address);
+bool bitmap_is_free(BITMAP *bitmap, int32_t cluster);
+void bitmap_set(FS *fs, BITMAP *bitmap, int32_t index, bool is_free);
+void bitmap_set_used(FS *fs, int32_t cluster);
+void bitmap_set_free(FS *fs, int32_t cluster);
+int32_t bitmap_count_free(BITMAP *bitmap);
+int32_t bitmap_find_free(BITMAP *bitmap);
+int32_t bitmap_find_run(BITMAP *bitmap, int32_t from, int32_t *length);
+uint16_t *refcounts_init(FS *fs, int32_t cluster_count);
+bool cluster_ref(FS *fs, int32_t cluster);
+bool cluster_unref(FS *fs, int32_t cluster);
+bool cluster_is_shared(FS *fs, int32_t cluster);
+int32_t cluster_make_private(FS *fs, int32_t cluster);
 
 void write_superblock_to_file(FS *fs);
 void write_bitmap_to_file(FS *fs);
-void update_current_directory(FS *fs);
-void read_sb_from_file(FS *fs);
+void write_refcounts_to_file(FS *fs);
+bool read_sb_from_file(FS *fs);
 void read_bitmap_from_file(FS *fs);
+void read_refcounts_from_file(FS *fs);
 
 void print_fs(FS *fs);
 void print_superblock(SUPERBLOCK *superblock);
@@ -6,13 +6,36 @@
 #include <stdio.h>
 #include <stdbool.h>
 
-#define FS_FILENAME_LENGTH 12
+#define SIGNATURE "toti"
+#define DESCRIPTOR "inodes pseudo file system"
+#define FS_FILENAME_LENGTH 4096
 #define DISK_SIZE 2000000       // 2MB
-#define CLUSTER_SIZE 1000
-#define INODES_COUNT 100
-#define MAX_COMMAND_LENGTH 40
+#define CLUSTER_SIZE 4096        // default, format can choose a power of two in CLUSTER_SIZE_MIN..CLUSTER_SIZE_MAX
+#define CLUSTER_SIZE_MIN 4096
+#define CLUSTER_SIZE_MAX (1024 * 1024)
+#define BYTES_PER_INODE 16384   // 1 i-node per 16KB of disk, unless format says otherwise
+#define INODES_MIN_COUNT 100
+#define MAX_COMMAND_LENGTH 4096
 #define MAX_FILENAME_LENGTH 12
 #define COUNT_DIRECT_LINK 5
+#define COUNT_EXTENTS 8
+#define IO_CHUNK_SIZE (1024 * 1024)   // 1MB - chunk for streaming host files
+#define BITMAP_WORD_BITS 64
+#define DENTRY_CACHE_SIZE 1024
+#define JOURNAL_MAGIC 0x4A534F5Au      // "ZOSJ"
+#define JOURNAL_MIN_SIZE (256 * 1024)
+#define JOURNAL_MAX_SIZE (16 * 1024 * 1024)
+#define STATS_BUCKETS 24                // latency histogram, bucket i counts commands shorter than 2^i us
+#define STATS_MAX_COMMANDS 32
+#define STATS_NAME_LENGTH 16
+#define TRACE_HEADER "# zos trace v1: <microseconds since start> <command>"
+#define SUPERBLOCK_MAGIC 0x46534F5Au    // "ZOSF", images of version 1 don't have it
+#define SUPERBLOCK_VERSION 2            // 64-bit sizes and addresses
+#define ARENA_BLOCK_SIZE (64 * 1024)    // per-command temporaries, bigger requests get their own block
+#define ARENA_ALIGNMENT 16
+
+// pocet 64bitovych slov bitmapy potrebnych pro dany pocet clusteru
+#define BITMAP_WORDS(count) (((count) + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
 
 #define SPLIT_ARGS_CHAR " "
 #define SHELL_CHAR "$"
@@ -30,6 +53,7 @@
 #define INFO "info"
 #define FILE_IN "incp"
 #define FILE_OUT "outcp"
+#define APPEND_FILE "append"
 #define LOAD_COMMANDS "load"
 #define FORMAT "format"
 #define S_LINK "slink"
@@ -37,11 +61,39 @@
 #define QUIT "quit"
 #define PRINT_FS "printfs"
 #define HELP "help"
+#define PRINT_STATS "stats"
 
 #define PATH_MAX 4096
 
+// zarovnani adres struktur v souboru FS
+#define STRUCT_ALIGNMENT 8
+// zarovnani zurnalu, zadna stranka mapovani (do 64KB) nesdili zurnal s jinymi daty
+#define JOURNAL_ALIGNMENT 65536
+#define ALIGN_UP(value, alignment) ((((value) + (alignment) - 1) / (alignment)) * (alignment))
+
 
 typedef struct superblock {
+    char signature[10];             // login autora FS
+    char volume_descriptor[251];    // popis FS
+    uint32_t magic;                 // SUPERBLOCK_MAGIC
+    uint32_t version;               // verze formatu obrazu
+    int64_t disk_size;              // celkova velikost FS
+    int32_t cluster_size;           // velikost clusteru
+    int32_t cluster_count;          // pocet clusteru
+    int32_t inode_count;            // pocet inodu
+
+    int64_t bitmap_start_address;   // adresa pocatku bitmapy datových bloků
+    int64_t refcount_start_address; // adresa pocatku tabulky referenci clusteru
+    int64_t inode_bitmap_start_address; // adresa pocatku bitmapy volnych i-nodu
+    int64_t inode_start_address;    // adresa pocatku  i-uzlů
+    int64_t journal_start_address;  // adresa pocatku zurnalu metadat
+    int64_t journal_size;           // velikost zurnalu metadat
+    int64_t data_start_address;     // adresa pocatku datovych bloku
+
+} SUPERBLOCK;
+
+// superblock obrazu verze 1 (32bitove velikosti a adresy), jen pro nacteni starsich obrazu
+typedef struct superblock_v1 {
     char signature[10];             // login autora FS
     char volume_descriptor[251];    // popis FS
     int32_t disk_size;              // celkova velikost FS
@@ -50,15 +102,21 @@ typedef struct superblock {
     int32_t inode_count;            // pocet inodu
 
     int32_t bitmap_start_address;   // adresa pocatku bitmapy datových bloků
+    int32_t refcount_start_address; // adresa pocatku tabulky referenci clusteru
+    int32_t inode_bitmap_start_address; // adresa pocatku bitmapy volnych i-nodu
     int32_t inode_start_address;    // adresa pocatku  i-uzlů
+    int32_t journal_start_address;  // adresa pocatku zurnalu metadat
+    int32_t journal_size;           // velikost zurnalu metadat
     int32_t data_start_address;     // adresa pocatku datovych bloku
 
-} SUPERBLOCK;
+} SUPERBLOCK_V1;
 
 
 typedef struct bitmap {
-    int32_t size;
-    bool *cluster_free;                 // 1 = true, 0 = false
+    int32_t size;                       // pocet clusteru
+    int32_t free_count;                 // pocet volnych clusteru
+    int32_t next_hint;                  // slovo, od ktereho zacina hledani volneho clusteru (next fit)
+    uint64_t *words;                    // 1 bit na cluster, 1 = volny, 0 = obsazeny
 } BITMAP;
 
 typedef struct directory_item {
@@ -66,11 +124,55 @@ typedef struct directory_item {
     char item_name[MAX_FILENAME_LENGTH];
 } DIRECTORY_ITEM;
 
+// hlavicka hashovaneho adresare, lezi ve slotu 0 a ma stejnou velikost jako DIRECTORY_ITEM
+typedef struct directory_header {
+    int32_t size;                       // pocet polozek adresare
+    int32_t capacity;                   // pocet slotu hashovaci tabulky (bez hlavicky)
+    int32_t reserved[2];
+} DIRECTORY_HEADER;
+
 typedef struct directory_items {
     int32_t size;
     DIRECTORY_ITEM *data;               // jednotlivé složky
 } DIRECTORY_ITEMS;
 
+typedef struct dentry {
+    int32_t parent_id;                  // id rodicovskeho adresare
+    int32_t node_id;                    // id i-nodu polozky, -1 = prazdny slot
+    char name[MAX_FILENAME_LENGTH];     // jmeno polozky
+} DENTRY;
+
+typedef struct dentry_cache {
+    DENTRY dentries[DENTRY_CACHE_SIZE]; // (rodic, jmeno) -> i-node, prime mapovani
+    DIRECTORY_ITEMS **directories;      // nacteny obsah adresaru podle id i-nodu
+    int32_t directory_count;            // pocet i-nodu
+    int64_t hits;                       // pocet nalezenych polozek
+    int64_t misses;                     // pocet nenalezenych polozek
+} DENTRY_CACHE;
+
+
+// transakce zurnalu = zmeny metadat jednoho prikazu, za hlavickou nasleduji zaznamy
+typedef struct journal_transaction {
+    uint32_t magic;
+    uint32_t n_of_records;              // pocet zaznamu
+    uint64_t sequence;                  // poradove cislo transakce
+    uint64_t length;                    // delka transakce vcetne hlavicky
+    uint32_t checksum;                  // kontrolni soucet zaznamu (FNV-1a)
+    uint32_t reserved;
+} JOURNAL_TRANSACTION;
+
+// zaznam transakce, za nim nasleduje length bajtu dat
+typedef struct journal_record {
+    uint64_t offset;                    // pozice dat v souboru FS
+    uint64_t length;                    // delka dat
+} JOURNAL_RECORD;
+
+
+typedef struct extent {
+    int32_t start;                      // prvni cluster souvisleho useku
+    int32_t length;                     // pocet clusteru v useku
+} EXTENT;
+
 
 typedef struct pseudo_inode {
     char id_name[10];
@@ -80,6 +182,7 @@ typedef struct pseudo_inode {
     bool is_free;
     int8_t isDirectory;                 // true = 1, false = 0
     int8_t isSLink;                     // true = 1, false = 0
+    int8_t isExtent;                    // true = 1 (data v extents), false = 0 (directs + indirects)
 
     int32_t linked_node_id;             // if inode is symbolic link
 
@@ -89,25 +192,113 @@ typedef struct pseudo_inode {
 
     int32_t indirect1;
     int32_t indirect2;
+    int32_t indirect_double;            // blok odkazu na bloky odkazu
+    int32_t indirect_triple;            // blok odkazu na bloky dvojite neprimych odkazu
+
+    EXTENT extents[COUNT_EXTENTS];      // souvisle useky clusteru, pokud isExtent = 1
 } PSEUDO_INODE;
 
 
+// stav postupneho prochazeni clusteru souboru, bloky odkazu se ctou az ve chvili, kdy jsou potreba
+typedef struct cluster_iterator {
+    PSEUDO_INODE *inode;
+    int32_t index;                      // logicky index dalsiho clusteru
+    int32_t *links;                     // dalsi odkaz v aktualnim bloku odkazu
+    int32_t n_of_links;                 // pocet zbyvajicich odkazu v bloku
+    int32_t pending;                    // cluster nacteny za koncem posledniho useku, -1 = zadny
+} CLUSTER_ITERATOR;
+
+// vysledek zapisu transakce do zurnalu
+#define JOURNAL_COMMITTED 0             // transakce je v zurnalu na disku
+#define JOURNAL_TOO_BIG 1               // transakce se do zurnalu nevejde
+#define JOURNAL_FAILED 2                // transakci nelze zapsat nebo synchronizovat
+
+// operace se vsemi clustery i-nodu
+#define CLUSTERS_CHECK 0                // lze clustery sdilet s dalsi kopii
+#define CLUSTERS_REF 1                  // pridat referenci
+#define CLUSTERS_UNREF 2                // odebrat referenci, posledni vlastnik cluster uvolni
+
 typedef struct inodes {
-    int32_t size;
-    PSEUDO_INODE data[INODES_COUNT];
+    int32_t size;                       // pocet i-nodu, urcuje ho superblock
+    int32_t reserved;
+    PSEUDO_INODE data[];                // tabulka i-nodu
 } INODES;
 
+// citace I/O souboru FS, od spusteni jen rostou
+typedef struct io_counters {
+    uint64_t bytes_read;                // bajty dat souboru prectene z mapovani
+    uint64_t bytes_written;             // bajty zapsane do souboru FS (data, zurnal i metadata)
+    uint64_t writes;                    // pocet volani pwrite
+    uint64_t seeks;                     // pocet volani lseek
+    uint64_t syncs;                     // pocet volani fdatasync
+    uint64_t page_faults;               // stranky mapovani nactene z disku (major page faults)
+    uint64_t clusters_allocated;        // pocet obsazenych clusteru
+    uint64_t clusters_freed;            // pocet uvolnenych clusteru
+    uint64_t inodes_allocated;          // pocet obsazenych i-nodu
+} IO_COUNTERS;
+
+// blok pameti pro docasne alokace prikazu
+typedef struct arena_block {
+    struct arena_block *next;           // dalsi blok, bloky zustavaji alokovane i po uvolneni
+    size_t size;                        // velikost dat bloku
+    size_t used;                        // obsazena cast dat
+    unsigned char data[];               // data bloku
+} ARENA_BLOCK;
+
+// stav areny, ke kteremu se po prikazu vraci
+typedef struct arena_mark {
+    ARENA_BLOCK *block;                 // aktualni blok
+    size_t used;                        // obsazena cast aktualniho bloku
+} ARENA_MARK;
+
+// statistiky jednoho prikazu shellu
+typedef struct command_stats {
+    char name[STATS_NAME_LENGTH];       // jmeno prikazu, musi byt prvni (stats_find_entry)
+    uint64_t calls;                     // pocet volani
+    uint64_t failures;                  // pocet neuspesnych volani
+    uint64_t total_ns;                  // celkovy cas
+    uint64_t max_ns;                    // nejdelsi volani
+    uint64_t histogram[STATS_BUCKETS];  // pocet volani podle casu, kos i = kratsi nez 2^i us
+    IO_COUNTERS io;                     // I/O behem prikazu
+} COMMAND_STATS;
+
+// statistiky prikazu a I/O za cely beh programu
+typedef struct stats {
+    COMMAND_STATS commands[STATS_MAX_COMMANDS]; // statistiky podle prikazu, posledni polozka je pro ostatni
+    int32_t n_of_commands;              // pocet pouzitych polozek
+    IO_COUNTERS io;                     // aktualni hodnoty citacu
+    COMMAND_STATS *last;                // posledni prikaz, dostane i I/O zapisu po svem konci (io_flush)
+    IO_COUNTERS last_end;               // citace na konci posledniho prikazu
+} STATS;
+
 typedef struct file_system {
     SUPERBLOCK *superblock;
+    SUPERBLOCK *converted_superblock;   // superblock obrazu starsi verze prevedeny do pameti, jinak NULL
     BITMAP *bitmap;
+    uint16_t *refcounts;                // pocet dalsich odkazu na cluster, 0 = cluster ma jednoho vlastnika
+    BITMAP *inode_bitmap;               // 1 bit na i-node, 1 = volny
     INODES *inodes;
 
     PSEUDO_INODE *current_inode;
-    DIRECTORY_ITEMS *current_directory;
 
     char *actual_path;
     char *filename;
-    FILE *FILE;
+
+    DENTRY_CACHE *cache;                // cache adresarovych polozek
+
+    int fd;                             // otevreny soubor FS
+    char *map;                          // soubor FS namapovany do pameti
+    size_t map_size;                    // velikost mapovani
+    size_t page_size;                   // velikost stranky mapovani
+    uint64_t *dirty_pages;              // 1 bit na stranku mapovani, 1 = zmenena od posledniho zapisu
+    uint64_t *meta_pages;               // 1 bit na stranku mapovani, 1 = obsahuje zmenena metadata (jdou pres zurnal)
+    size_t dirty_data_pages;            // pocet zmenenych stranek jen s daty souboru
+    size_t dirty_meta_pages;            // pocet zmenenych stranek s metadaty
+    uint64_t *freed_clusters;           // 1 bit na cluster, 1 = uvolneny od posledniho io_flush, do souboru se v nem vyrazi dira
+    size_t n_of_freed_clusters;         // pocet takto uvolnenych clusteru
+
+    int64_t journal_head;               // pozice dalsi transakce v zurnalu
+    uint64_t journal_sequence;          // poradove cislo dalsi transakce
 } FS;
 
 
@@ -117,7 +308,4 @@ void assign_clusters(FS *fs, PSEUDO_INODE *inode);
 // fs
 bool is_absolute_path(char *path);
 
-// main
-void commands(FS *fs, char *token);
-
 #endif
\ No newline at end of file
@@ -5,23 +5,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include "inodes.h"
 #include "directory.h"
 #include "header.h"
+#include "fs.h"
+#include "io.h"
+#include "cache.h"
+#include "stats.h"
+#include "arena.h"
 
 /**
- * Inicializuje strukturu inodes.
+ * Inicializuje strukturu inodes a bitmapu volných i-nodů v namapovaném souboru FS.
  *
+ * @param fs - struktura file systému
  * @param count počet inodů
  *
  * @return struktura inodes
  */
-INODES *inodes_init(int32_t count) {
+INODES *inodes_init(FS *fs, int32_t count) {
     char tmp[10];
     memset(tmp, 0, 8);
 
-    // allocation
-    INODES *inodes = calloc(1, sizeof(INODES));
+    // all i-nodes are free
+    fs->inode_bitmap = bitmap_init(fs, fs->superblock->inode_bitmap_start_address, count);
+
+    // inode table lives in the mapped file after the free i-node bitmap
+    INODES *inodes = (INODES *) io_ptr(fs, fs->superblock->inode_start_address);
+    memset(inodes, 0, sizeof(INODES) + (size_t) count * sizeof(PSEUDO_INODE));
 
     // set size
     inodes->size = count;
@@ -39,6 +50,8 @@ INODES *inodes_init(int32_t count) {
 
         inodes->data[i].indirect1 = -1;
         inodes->data[i].indirect2 = -1;
+        inodes->data[i].indirect_double = -1;
+        inodes->data[i].indirect_triple = -1;
 
         inodes->data[i].count_clusters = -1;
         inodes->data[i].file_size = -1;
@@ -47,6 +60,12 @@ INODES *inodes_init(int32_t count) {
             inodes->data[i].directs[j] = -1;
         }
 
+        inodes->data[i].isExtent = false;
+        for (int j = 0; j < COUNT_EXTENTS; j++) {
+            inodes->data[i].extents[j].start = -1;
+            inodes->data[i].extents[j].length = 0;
+        }
+
         snprintf(tmp, 10, "node%d", i);     // /0
         strcpy(inodes->data[i].id_name, tmp);
         memset(tmp, 0, 8);
@@ -55,22 +74,38 @@ INODES *inodes_init(int32_t count) {
 }
 
 /**
- * Vrátí volný i-node.
+ * Vrátí volný i-node. I-node se hledá v bitmapě volných i-nodů a obsazeným se stane až při
+ * inicializaci (init_pseudoinode, init_slink, create_directory_item).
  *
  * @param fs - struktura file systému
  * @return  volný inode
  */
 PSEUDO_INODE *get_free_inode(FS *fs) {
-    // go through inodes and return the first free i-node
-    for (int i = 0; i < fs->inodes->size; ++i) {
-        if (fs->inodes->data[i].is_free == true)  {
-            return &fs->inodes->data[i];
-        }
-    }
+    int32_t node_id = bitmap_find_free(fs->inode_bitmap);
 
     // no free i-nodes found
-    printf("No free i-node found.\n");
-    return NULL;
+    if (node_id == -1) {
+        printf("No free i-node found.\n");
+        return NULL;
+    }
+
+    return &fs->inodes->data[node_id];
+}
+
+/**
+ * Označí i-node jako volný nebo obsazený, v i-nodu i v bitmapě volných i-nodů.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node
+ * @param is_free - true = volný, false = obsazený
+ */
+void set_inode_free(FS *fs, PSEUDO_INODE *inode, bool is_free) {
+    if (inode->is_free == true && is_free == false) {
+        stats.io.inodes_allocated++;
+    }
+    inode->is_free = is_free;
+    bitmap_set(fs, fs->inode_bitmap, inode->node_id, is_free);
+    write_inode_to_file(fs, inode);
 }
 
 /**
@@ -92,40 +127,129 @@ void assign_clusters(FS *fs, PSEUDO_INODE *inode) {
 
     for (int i = 0; i < n_of_clusters; ++i) {
         // get index of free cluster
-        int index_of_free_cluster = get_cluster(fs);
-
-        inode->directs[i] = index_of_free_cluster;
-        fs->bitmap->cluster_free[index_of_free_cluster] = false;
+        inode->directs[i] = get_cluster(fs);
     }
 }
 
 /**
- * Vrátí index volného clusteru.
+ * Vrátí index volného clusteru a označí jej v bitmapě jako obsazený. Hledání začíná od slova bitmapy,
+ * kde skončila poslední alokace (next fit), a prochází bitmapu po 64bitových slovech.
  *
  * @param fs - struktura file systému
  * @return      index volného clusteru
  *              -1, pokud volný cluster neexistuje
  */
 int32_t  get_cluster(FS *fs){
-    for (int i = 0; i < fs->bitmap->size; ++i) {
-        if(fs->bitmap->cluster_free[i] == true)  {
-            return i;
+    int32_t cluster = bitmap_find_free(fs->bitmap);
+
+    if (cluster == -1) {
+        printf("Free cluster not found.\n");
+        return -1;
+    }
+
+    bitmap_set_used(fs, cluster);
+    return cluster;
+}
+
+/**
+ * Najde pro soubor nejvýše COUNT_EXTENTS souvislých úseků volných clusterů s celkem count clustery a označí je
+ * v bitmapě jako obsazené. Přednostně vybere první úsek, do kterého se vejde celý soubor, jinak poskládá soubor
+ * z nejdelších volných úseků.
+ *
+ * @param fs - struktura file systému
+ * @param count - potřebný počet clusterů
+ * @param extents - výstup, nalezené úseky seřazené podle pozice na disku
+ *
+ * @return  počet použitých úseků
+ *          -1, pokud se soubor do COUNT_EXTENTS úseků nevejde
+ */
+int32_t get_extents(FS *fs, int32_t count, EXTENT extents[COUNT_EXTENTS]) {
+    BITMAP *bitmap = fs->bitmap;
+    EXTENT longest[COUNT_EXTENTS];
+    int32_t n_of_longest = 0;
+    int32_t n_of_extents = 0;
+    int32_t length = 0;
+
+    if (count <= 0 || bitmap->free_count < count) {
+        return -1;
+    }
+
+    for (int32_t start = bitmap_find_run(bitmap, 0, &length); start != -1;
+         start = bitmap_find_run(bitmap, start + length, &length)) {
+        // the whole file fits into this run
+        if (length >= count) {
+            longest[0].start = start;
+            longest[0].length = count;
+            n_of_longest = 1;
+            break;
+        }
+
+        // keep the longest runs, sorted from the longest one
+        if (n_of_longest < COUNT_EXTENTS || length > longest[n_of_longest - 1].length) {
+            int32_t i = n_of_longest < COUNT_EXTENTS ? n_of_longest++ : COUNT_EXTENTS - 1;
+            while (i > 0 && longest[i - 1].length < length) {
+                longest[i] = longest[i - 1];
+                i--;
+            }
+            longest[i].start = start;
+            longest[i].length = length;
+        }
+    }
+
+    // take the longest runs until the file is covered
+    int32_t remaining = count;
+    for (int i = 0; i < n_of_longest && remaining > 0; ++i) {
+        extents[n_of_extents] = longest[i];
+        if (extents[n_of_extents].length > remaining) {
+            extents[n_of_extents].length = remaining;
+        }
+        remaining -= extents[n_of_extents].length;
+        n_of_extents++;
+    }
+
+    if (remaining > 0) {
+        return -1;
+    }
+
+    // order the extents by position, so the file is read and written front to back
+    for (int i = 1; i < n_of_extents; ++i) {
+        EXTENT extent = extents[i];
+        int j = i;
+        while (j > 0 && extents[j - 1].start > extent.start) {
+            extents[j] = extents[j - 1];
+            j--;
         }
+        extents[j] = extent;
     }
 
-    printf("Free cluster not found.\n");
-    return -1;
+    for (int i = 0; i < n_of_extents; ++i) {
+        for (int j = 0; j < extents[i].length; ++j) {
+            bitmap_set_used(fs, extents[i].start + j);
+        }
+    }
+
+    return n_of_extents;
 }
 
 /**
- * Zapíše i-nodes strukturu do souboru file sustému.
+ * Zapíše celou i-nodes strukturu a bitmapu volných i-nodů do souboru file sustému (při formátování).
  *
  * @param fs - struktura file systému
  */
 void write_inodes_to_file(FS *fs) {
-    fseek(fs->FILE, fs->superblock->inode_start_address, SEEK_SET);
-    fwrite(fs->inodes, sizeof(INODES), 1, fs->FILE);
-    fflush(fs->FILE);
+    io_mark_dirty(fs, fs->inode_bitmap, sizeof(BITMAP) + BITMAP_WORDS(fs->inode_bitmap->size) * sizeof(uint64_t));
+    io_mark_dirty(fs, fs->inodes, sizeof(INODES) + (size_t) fs->inodes->size * sizeof(PSEUDO_INODE));
+}
+
+/**
+ * Zapíše jeden i-node do souboru file systému. Zápis proběhne na konci příkazu, stačí proto
+ * i-node označit kdykoli během příkazu.
+ *
+ * @param fs - struktura file systému
+ * @param inode - změněný i-node
+ */
+void write_inode_to_file(FS *fs, PSEUDO_INODE *inode) {
+    io_mark_dirty(fs, inode, sizeof(PSEUDO_INODE));
 }
 
 /**
@@ -134,18 +258,8 @@ void write_inodes_to_file(FS *fs) {
  * @param fs - struktura file systému
  */
 void read_inodes_from_file(FS *fs) {
-    // inodes exist -> free and set to null
-    if (fs->inodes != NULL) {
-        free(fs->inodes);
-        fs->inodes = NULL;
-    }
-
-    INODES *inodes = calloc(1, sizeof(INODES));
-
-    fseek(fs->FILE, fs->superblock->inode_start_address, SEEK_SET);
-    fread(inodes, sizeof(INODES), 1, fs->FILE);
-
-    fs->inodes = inodes;
+    fs->inode_bitmap = bitmap_load(fs, fs->superblock->inode_bitmap_start_address);
+    fs->inodes = (INODES *) io_ptr(fs, fs->superblock->inode_start_address);
 }
 
 /**
@@ -174,17 +288,34 @@ void print_inode(PSEUDO_INODE *inode) {
         printf("slink: false, ");
     }
 
-    printf("fs: %ldB, ", inode->file_size);
+    printf("fs: %" PRId64 "B, ", inode->file_size);
     printf("cs: %d, ", inode->count_clusters);
     for (int i = 0; i < COUNT_DIRECT_LINK; i++) {
         printf("di: %d, ", inode->directs[i]);
     }
     printf("ind: %d, ", inode->indirect1);
-    printf("ind: %d \n", inode->indirect2);
+    printf("ind: %d, ", inode->indirect2);
+    printf("dind: %d, ", inode->indirect_double);
+    printf("tind: %d", inode->indirect_triple);
+    print_extents(inode);
 }
 
 /**
- * Vypíše strukturu i-nodes.
+ * Vypíše extenty i-nodu (pokud je v extent módu) a ukončí řádek.
+ *
+ * @param inode
+ */
+void print_extents(PSEUDO_INODE *inode) {
+    if (inode->isExtent == true) {
+        for (int i = 0; i < COUNT_EXTENTS && inode->extents[i].length > 0; i++) {
+            printf(", ext: %d+%d", inode->extents[i].start, inode->extents[i].length);
+        }
+    }
+    printf(" \n");
+}
+
+/**
+ * Vypíše strukturu i-nodes. Volné i-nody se nevypisují.
  *
  * @param inodes
  */
@@ -192,7 +323,9 @@ void print_inodes(INODES *inodes) {
     printf("--- INODES ---\n");
     printf("Inodes size: %d\n", inodes->size);
     for (int i = 0; i < inodes->size; ++i) {
-        print_inode(&inodes->data[i]);
+        if (inodes->data[i].is_free == false) {
+            print_inode(&inodes->data[i]);
+        }
     }
     printf("\n");
 }
@@ -302,26 +435,25 @@ PSEUDO_INODE *get_inode(FS *fs, char *path, int32_t type) {
  * @return hledaný i-node
  */
 PSEUDO_INODE *search_for_inode(FS *fs, PSEUDO_INODE *start_inode, char *path, bool search_from_current_node) {
+    char temp_path[PATH_MAX];
+    strncpy(temp_path, path, PATH_MAX - 1);
+    temp_path[PATH_MAX - 1] = '\0';
 
-    char *temp_path = calloc(strlen(path) + 1, sizeof(path));
-    strcpy(temp_path, path);
-
-    // reference to current directory
-    DIRECTORY_ITEMS *current_directory = NULL;
-
+    // directory the search starts in
     PSEUDO_INODE *current_inode = NULL;
-    char *name_file;
-    char temp_name_file[3];
-
-    // should we search in current directory, or do we need to load whole structure
+    PSEUDO_INODE *directory_inode = start_inode;
     if (search_from_current_node == true) {
-        current_directory = fs->current_directory;
-    } else {
-        current_directory = read_directory_items_from_file(fs, start_inode);
+        directory_inode = fs->current_inode;
     }
 
+    char *name_file;
+    char temp_name_file[3];
+
     // get first part of the path
     name_file = strtok(temp_path, "/");
+    if (name_file == NULL) {
+        return NULL;
+    }
 
     // path does not contain more '/'
     if (contains_char(temp_path, '/') == false) {
@@ -344,38 +476,18 @@ PSEUDO_INODE *search_for_inode(FS *fs, PSEUDO_INODE *start_inode, char *path, bo
         }
     }
 
-    bool found = false;
-    int index = 0;
-
     while (name_file != NULL) {
         if (strlen(name_file) > 0) {
-            if (current_inode != NULL && current_inode->isDirectory == false) {
+            if (directory_inode->isDirectory == false) {
                 return NULL;
             }
 
-            while (found == false && current_directory->size > index) {
-                if (are_strings_equal(current_directory->data[index].item_name, name_file) == true) {
-
-                    INODES *inodes = fs->inodes;
-                    current_inode = &inodes->data[current_directory->data[index].node_id];
-
-                    if (current_inode->isDirectory == true) {       // i-node is directory
-                        current_directory = read_directory_items_from_file(fs, current_inode);
-                        found = true;
-                    } else {        // i-node is file
-                        current_directory = NULL;
-                        found = true;
-                    }
-                }
-                index++;
-            }
-
-            // node not found
-            if (found == false) {
+            // (parent, name) -> i-node, the directory is read only on a cache miss
+            current_inode = cache_lookup(fs, directory_inode, name_file);
+            if (current_inode == NULL) {
                 return NULL;
             }
-            found = false;
-            index = 0;
+            directory_inode = current_inode;
         }
 
         // get another part of the path
@@ -394,27 +506,14 @@ PSEUDO_INODE *search_for_inode(FS *fs, PSEUDO_INODE *start_inode, char *path, bo
  *          false - neshodují se
  */
 bool are_strings_equal(char *string1, char *string2) {
-    char s1[strlen(string1)];
-    char s2[strlen(string2)];
+    size_t length1 = strlen(string1);
+    size_t length2 = strlen(string2);
 
-    strcpy(s1, string1);
-    strcpy(s2, string2);
+    // trailing new line is ignored
+    if (length1 > 0 && string1[length1 - 1] == '\n') length1--;
+    if (length2 > 0 && string2[length2 - 1] == '\n') length2--;
 
-    if (strlen(s1) > 0 && s1[strlen(s1) - 1] == '\n') s1[strlen(s1) - 1] = '\0';
-    if (strlen(s2) > 0 && s2[strlen(s2) - 1] == '\n') s2[strlen(s2) - 1] = '\0';
-
-    if (strlen(s1) != strlen(s2)) {
-        return false;
-    }
-    else {
-        int i;
-        for (i = 0; i < strlen(s1); i++) {
-            if (s1[i] != s2[i]) {
-                return false;
-            }
-        }
-        return true;
-    }
+    return length1 == length2 && strncmp(string1, string2, length1) == 0;
 }
 
 /**
@@ -439,12 +538,12 @@ bool contains_char(char *string, char pattern) {
  *
  * @param path cesta
  *
- * @return pointer na filename
+ * @return pointer na filename v areně příkazu
  */
 char *get_filename_from_path(char *path) {
-    char *name = calloc(FS_FILENAME_LENGTH, sizeof(char));
-    char *temp_path_to_parent = calloc(PATH_MAX, sizeof(char));
-    char *tmp = calloc(FS_FILENAME_LENGTH, sizeof(char));
+    char *name = arena_alloc(FS_FILENAME_LENGTH);
+    char *temp_path_to_parent = arena_alloc(PATH_MAX);
+    char *tmp = arena_alloc(PATH_MAX);
 
     // path starts with ./
     if (path[0] == '.' && path[1] == '/') {
@@ -511,99 +610,854 @@ int32_t get_last_index_of_slash(char *string, char pattern){
  *
  * @return PSEUDO_INODE
  */
-PSEUDO_INODE * init_pseudoinode(FS *fs, int32_t id_node, int32_t parent_id, bool isFree, bool isDirectory, int32_t file_size,
+PSEUDO_INODE * init_pseudoinode(FS *fs, int32_t id_node, int32_t parent_id, bool isFree, bool isDirectory, int64_t file_size,
                  int32_t count_clusters, int32_t directs[COUNT_DIRECT_LINK], int32_t indirect1, int32_t indirect2) {
     INODES *inodes = fs->inodes;
     PSEUDO_INODE *inode = &inodes->data[id_node];
     inode->parent_id = parent_id;
     inode->isDirectory = isDirectory;
     inode->file_size = file_size;
-    inode->is_free = isFree;
     inode->count_clusters = count_clusters;
     for (int j = 0; j < COUNT_DIRECT_LINK; j++) {
         inode->directs[j] = directs[j];
     }
     inode->indirect1 = indirect1;
     inode->indirect2 = indirect2;
+    inode->indirect_double = -1;
+    inode->indirect_triple = -1;
+
+    inode->isExtent = false;
+    for (int j = 0; j < COUNT_EXTENTS; j++) {
+        inode->extents[j].start = -1;
+        inode->extents[j].length = 0;
+    }
 
+    set_inode_free(fs, inode, isFree);
     return inode;
 }
 
 /**
- * Zapíše obsah příslušných clusterů do souboru FS.
+ * Přepne i-node do extent módu a uloží do něj extenty.
+ *
+ * @param inode - i-node souboru
+ * @param extents - souvislé úseky clusterů
+ * @param n_of_extents - počet úseků
+ */
+void set_inode_extents(PSEUDO_INODE *inode, EXTENT *extents, int32_t n_of_extents) {
+    inode->isExtent = true;
+    for (int i = 0; i < COUNT_EXTENTS; i++) {
+        if (i < n_of_extents) {
+            inode->extents[i] = extents[i];
+        } else {
+            inode->extents[i].start = -1;
+            inode->extents[i].length = 0;
+        }
+    }
+}
+
+/**
+ * Vrátí počet odkazů na clustery, které se vejdou do jednoho bloku odkazů.
  *
  * @param fs - struktura file systému
- * @param new_inode - inode, jehož buffer chceme zapsat
- * @param clusters - datové bloky
- * @param buffer - data
+ *
+ * @return počet odkazů v bloku
+ */
+static int64_t inode_links_per_block(FS *fs) {
+    return fs->superblock->cluster_size / sizeof(int32_t);
+}
+
+/**
+ * Vrátí největší počet clusterů, který může i-node adresovat přímými, nepřímými, dvojitě
+ * a trojitě nepřímými odkazy.
+ *
+ * @param fs - struktura file systému
+ *
+ * @return počet clusterů
  */
-void write_clusters_to_file(FS *fs, PSEUDO_INODE *new_inode, int32_t *clusters, char **buffer) {
+int32_t inode_max_clusters(FS *fs) {
+    int64_t n = inode_links_per_block(fs);
+    int64_t max = COUNT_DIRECT_LINK + 2 * n + n * n + n * n * n;
+
+    return max > INT32_MAX ? INT32_MAX : (int32_t) max;
+}
 
-    fs->FILE = fopen(fs->filename, "rb+");
-    int32_t actual_size = new_inode->file_size;
+/**
+ * Vrátí počet bloků odkazů, které potřebuje soubor s daným počtem clusterů.
+ *
+ * @param fs - struktura file systému
+ * @param count - počet datových clusterů
+ *
+ * @return počet bloků odkazů
+ */
+int32_t inode_pointer_blocks(FS *fs, int32_t count) {
+    int64_t n = inode_links_per_block(fs);
+    int64_t rest = (int64_t) count - COUNT_DIRECT_LINK;
+    int64_t blocks = 0;
+
+    // two single indirect blocks
+    for (int i = 0; i < 2 && rest > 0; i++) {
+        blocks++;
+        rest -= n;
+    }
 
-    // number of indirect links
-    int32_t n_of_indirects = 0;
-    if (new_inode->indirect1 != -1) {
-        n_of_indirects++;
+    // double indirect - the block itself and one block of links per n clusters
+    if (rest > 0) {
+        int64_t part = rest < n * n ? rest : n * n;
+        blocks += 1 + (part + n - 1) / n;
+        rest -= part;
     }
-    if (new_inode->indirect2 != -1) {
-        n_of_indirects++;
+
+    // triple indirect - the block itself, one block per n * n and one block per n clusters
+    if (rest > 0) {
+        blocks += 1 + (rest + n * n - 1) / (n * n) + (rest + n - 1) / n;
     }
 
-    // number of clusters that needs to use indirect links
-    int32_t cluster_overflow = new_inode->count_clusters - COUNT_DIRECT_LINK;
-    // how many int32 can go to one cluster
-    int32_t n_of_ints_in_clusters = fs->superblock->cluster_size / sizeof(int32_t);
+    return (int32_t) blocks;
+}
 
-    // go through clusters
-    for (int i = 0; i < new_inode->count_clusters; i++) {
-        if (i < COUNT_DIRECT_LINK) {
-            fseek(fs->FILE,fs->superblock->data_start_address + (new_inode->directs[i] * fs->superblock->cluster_size), SEEK_SET);
-        } else {
-            fseek(fs->FILE, fs->superblock->data_start_address + (clusters[i - COUNT_DIRECT_LINK]
-                                                                  * fs->superblock->cluster_size), SEEK_SET);
+/**
+ * Najde odkaz v i-nodu, pod kterým leží cluster s daným indexem (přímý odkaz nebo kořen stromu
+ * bloků odkazů), a pozici clusteru v tomto stromu.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node s přímými a nepřímými odkazy
+ * @param index - logický index clusteru v souboru
+ * @param levels - výstup, počet úrovní bloků odkazů pod kořenem (0 = přímý odkaz)
+ * @param rest - výstup, pozice clusteru ve stromu
+ *
+ * @return ukazatel na odkaz v i-nodu
+ */
+static int32_t *inode_root_link(FS *fs, PSEUDO_INODE *inode, int32_t index, int32_t *levels, int64_t *rest) {
+    int64_t n = inode_links_per_block(fs);
+
+    *rest = (int64_t) index - COUNT_DIRECT_LINK;
+    if (*rest < 0) {
+        *levels = 0;
+        return &inode->directs[index];
+    }
+    if (*rest < n) {
+        *levels = 1;
+        return &inode->indirect1;
+    }
+    *rest -= n;
+    if (*rest < n) {
+        *levels = 1;
+        return &inode->indirect2;
+    }
+    *rest -= n;
+    if (*rest < n * n) {
+        *levels = 2;
+        return &inode->indirect_double;
+    }
+    *rest -= n * n;
+    *levels = 3;
+    return &inode->indirect_triple;
+}
+
+/**
+ * Vrátí odkaz na cluster s daným indexem, bloky odkazů se čtou jen po cestě ke clusteru.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node s přímými a nepřímými odkazy
+ * @param index - logický index clusteru v souboru
+ *
+ * @return  ukazatel na odkaz
+ *          NULL, pokud na cestě chybí blok odkazů
+ */
+static int32_t *inode_find_link(FS *fs, PSEUDO_INODE *inode, int32_t index) {
+    int64_t n = inode_links_per_block(fs);
+    int32_t levels;
+    int64_t rest;
+    int32_t *link = inode_root_link(fs, inode, index, &levels, &rest);
+
+    int64_t span = 1;
+    for (int level = 1; level < levels; level++) {
+        span *= n;
+    }
+
+    for (int level = 0; level < levels; level++) {
+        if (*link == -1) {
+            return NULL;
         }
+        link = (int32_t *) cluster_ptr(fs, *link) + rest / span;
+        rest %= span;
+        span /= n;
+    }
 
-        if (actual_size >= fs->superblock->cluster_size) {
-            fwrite(buffer[i], sizeof(char), fs->superblock->cluster_size, fs->FILE);
-            actual_size -= fs->superblock->cluster_size;
-        } else {
-            fwrite(buffer[i], sizeof(char), actual_size, fs->FILE);
+    return link;
+}
+
+/**
+ * Vrátí počet clusterů, které spotřebuje změna odkazu na cluster s daným indexem - nové bloky
+ * odkazů při přidání clusteru a kopie sdílených bloků odkazů na cestě.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node s přímými a nepřímými odkazy
+ * @param index - logický index clusteru v souboru
+ *
+ * @return počet clusterů
+ */
+static int32_t inode_link_cost(FS *fs, PSEUDO_INODE *inode, int32_t index) {
+    int64_t n = inode_links_per_block(fs);
+    bool append = index == inode->count_clusters;
+    int32_t levels;
+    int64_t rest;
+    int32_t *link = inode_root_link(fs, inode, index, &levels, &rest);
+
+    int64_t span = 1;
+    for (int level = 1; level < levels; level++) {
+        span *= n;
+    }
+
+    int32_t cost = 0;
+    for (int level = 0; level < levels; level++) {
+        // this block and all blocks below it are new
+        if (append == true && rest == 0) {
+            return cost + levels - level;
+        }
+        if (cluster_is_shared(fs, *link) == true) {
+            cost++;
+        }
+        link = (int32_t *) cluster_ptr(fs, *link) + rest / span;
+        rest %= span;
+        span /= n;
+    }
+
+    return cost;
+}
+
+/**
+ * Vrátí odkaz na cluster s daným indexem, do kterého lze zapisovat. Bloky odkazů na cestě, které
+ * ještě neexistují, se alokují, sdílené bloky se před zápisem zkopírují (copy-on-write).
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node s přímými a nepřímými odkazy
+ * @param index - logický index clusteru v souboru, nejvýše count_clusters
+ *
+ * @return  ukazatel na odkaz
+ *          NULL, pokud nejsou volné clustery
+ */
+static int32_t *inode_link(FS *fs, PSEUDO_INODE *inode, int32_t index) {
+    int64_t n = inode_links_per_block(fs);
+    bool append = index == inode->count_clusters;
+    int32_t levels;
+    int64_t rest;
+    int32_t *link = inode_root_link(fs, inode, index, &levels, &rest);
+
+    int64_t span = 1;
+    for (int level = 1; level < levels; level++) {
+        span *= n;
+    }
+
+    for (int level = 0; level < levels; level++) {
+        // the first appended cluster under a block needs the block itself
+        int32_t block = (append == true && rest == 0) ? get_cluster(fs) : cluster_make_private(fs, *link);
+        if (block == -1) {
+            return NULL;
+        }
+        if (block != *link) {
+            *link = block;
+            io_mark_dirty(fs, link, sizeof(int32_t));
+        }
+
+        link = (int32_t *) cluster_ptr(fs, block) + rest / span;
+        rest %= span;
+        span /= n;
+    }
+
+    return link;
+}
+
+/**
+ * Připojí cluster na konec i-nodu s přímými a nepřímými odkazy.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node s přímými a nepřímými odkazy
+ * @param cluster - připojovaný cluster
+ *
+ * @return  true - cluster byl připojen
+ *          false - nejsou volné clustery pro bloky odkazů
+ */
+static bool inode_append_link(FS *fs, PSEUDO_INODE *inode, int32_t cluster) {
+    int32_t *link = inode_link(fs, inode, inode->count_clusters);
+    if (link == NULL) {
+        return false;
+    }
+
+    *link = cluster;
+    io_mark_dirty(fs, link, sizeof(int32_t));
+    inode->count_clusters++;
+    write_inode_to_file(fs, inode);
+
+    return true;
+}
+
+/**
+ * Převede logický index clusteru souboru na fyzický cluster (přímé odkazy, nepřímé odkazy nebo extenty).
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ * @param index - logický index clusteru v souboru
+ *
+ * @return  index fyzického clusteru
+ *          -1, pokud soubor tolik clusterů nemá
+ */
+int32_t inode_get_cluster(FS *fs, PSEUDO_INODE *inode, int32_t index) {
+    if (index < 0 || index >= inode->count_clusters) {
+        return -1;
+    }
+
+    // extent mode
+    if (inode->isExtent == true) {
+        for (int i = 0; i < COUNT_EXTENTS && inode->extents[i].length > 0; i++) {
+            if (index < inode->extents[i].length) {
+                return inode->extents[i].start + index;
+            }
+            index -= inode->extents[i].length;
+        }
+        return -1;
+    }
+
+    // direct, indirect, double and triple indirect links
+    int32_t *link = inode_find_link(fs, inode, index);
+    return (link == NULL) ? -1 : *link;
+}
+
+/**
+ * Připraví procházení clusterů souboru od začátku.
+ *
+ * @param iterator - stav procházení
+ * @param inode - i-node souboru
+ */
+void cluster_iterator_init(CLUSTER_ITERATOR *iterator, PSEUDO_INODE *inode) {
+    iterator->inode = inode;
+    iterator->index = 0;
+    iterator->links = NULL;
+    iterator->n_of_links = 0;
+    iterator->pending = -1;
+}
+
+/**
+ * Vrátí další cluster souboru. Bloky odkazů se nenačítají dopředu - cesta k bloku se projde,
+ * až když jsou odkazy předchozího bloku vyčerpané.
+ *
+ * @param fs - struktura file systému
+ * @param iterator - stav procházení
+ *
+ * @return  index fyzického clusteru
+ *          -1, pokud už soubor další cluster nemá
+ */
+int32_t cluster_iterator_next(FS *fs, CLUSTER_ITERATOR *iterator) {
+    PSEUDO_INODE *inode = iterator->inode;
+
+    if (iterator->index >= inode->count_clusters) {
+        return -1;
+    }
+    if (inode->isExtent == true) {
+        return inode_get_cluster(fs, inode, iterator->index++);
+    }
+
+    if (iterator->n_of_links == 0) {
+        iterator->links = inode_find_link(fs, inode, iterator->index);
+        if (iterator->links == NULL) {
+            return -1;
+        }
+
+        // links left in the same block (or in the direct links)
+        int64_t rest = (int64_t) iterator->index - COUNT_DIRECT_LINK;
+        int64_t n = inode_links_per_block(fs);
+        iterator->n_of_links = (rest < 0) ? (int32_t) -rest : (int32_t) (n - rest % n);
+    }
+
+    iterator->n_of_links--;
+    iterator->index++;
+    return *iterator->links++;
+}
+
+/**
+ * Vrátí další souvislý úsek clusterů souboru, fyzicky sousedící clustery se spojí.
+ *
+ * @param fs - struktura file systému
+ * @param iterator - stav procházení
+ * @param run - výstup, úsek clusterů
+ *
+ * @return  true - úsek byl vrácen
+ *          false - soubor už další clustery nemá
+ */
+bool cluster_iterator_next_run(FS *fs, CLUSTER_ITERATOR *iterator, EXTENT *run) {
+    int32_t cluster = (iterator->pending != -1) ? iterator->pending : cluster_iterator_next(fs, iterator);
+    if (cluster == -1) {
+        return false;
+    }
+
+    run->start = cluster;
+    run->length = 1;
+    while ((cluster = cluster_iterator_next(fs, iterator)) != -1 && cluster == run->start + run->length) {
+        run->length++;
+    }
+    iterator->pending = cluster;
+
+    return true;
+}
+
+/**
+ * Provede operaci s jedním clusterem i-nodu.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - datový cluster nebo blok odkazů
+ * @param operation - CLUSTERS_CHECK, CLUSTERS_REF nebo CLUSTERS_UNREF
+ *
+ * @return  true - operace proběhla (CLUSTERS_CHECK - cluster lze sdílet ještě jednou)
+ *          false - jinak
+ */
+static bool inode_visit_cluster(FS *fs, int32_t cluster, int operation) {
+    switch (operation) {
+        case CLUSTERS_CHECK:
+            return fs->refcounts[cluster] < UINT16_MAX;
+        case CLUSTERS_REF:
+            cluster_ref(fs, cluster);
+            return true;
+        default:
+            cluster_unref(fs, cluster);
+            return true;
+    }
+}
+
+/**
+ * Provede operaci se stromem bloků odkazů - nejdřív s clustery pod blokem, potom s blokem samotným,
+ * uvolněný blok se tak už nečte.
+ *
+ * @param fs - struktura file systému
+ * @param block - kořen stromu
+ * @param levels - počet úrovní bloků odkazů (0 = datový cluster)
+ * @param count - počet datových clusterů ve stromu
+ * @param operation - CLUSTERS_CHECK, CLUSTERS_REF nebo CLUSTERS_UNREF
+ *
+ * @return false, pokud operace s některým clusterem selhala
+ */
+static bool inode_visit_block(FS *fs, int32_t block, int32_t levels, int64_t count, int operation) {
+    if (block == -1 || count <= 0) {
+        return true;
+    }
+
+    if (levels > 0) {
+        int64_t span = 1;
+        for (int level = 1; level < levels; level++) {
+            span *= inode_links_per_block(fs);
+        }
+
+        int32_t *links = (int32_t *) cluster_ptr(fs, block);
+        for (int64_t i = 0; i * span < count; i++) {
+            int64_t child_count = (count - i * span < span) ? count - i * span : span;
+            if (inode_visit_block(fs, links[i], levels - 1, child_count, operation) == false) {
+                return false;
+            }
+        }
+    }
+
+    return inode_visit_cluster(fs, block, operation);
+}
+
+/**
+ * Provede operaci se všemi clustery i-nodu - datovými clustery i bloky odkazů.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ * @param operation - CLUSTERS_CHECK, CLUSTERS_REF nebo CLUSTERS_UNREF
+ *
+ * @return false, pokud operace s některým clusterem selhala
+ */
+static bool inode_visit_clusters(FS *fs, PSEUDO_INODE *inode, int operation) {
+    if (inode->isExtent == true) {
+        for (int i = 0; i < COUNT_EXTENTS && inode->extents[i].length > 0; i++) {
+            for (int j = 0; j < inode->extents[i].length; j++) {
+                if (inode_visit_cluster(fs, inode->extents[i].start + j, operation) == false) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    int64_t n = inode_links_per_block(fs);
+    int64_t rest = inode->count_clusters;
+    for (int i = 0; i < COUNT_DIRECT_LINK && i < rest; i++) {
+        if (inode_visit_block(fs, inode->directs[i], 0, 1, operation) == false) {
+            return false;
+        }
+    }
+    rest -= COUNT_DIRECT_LINK;
+
+    int32_t roots[] = {inode->indirect1, inode->indirect2, inode->indirect_double, inode->indirect_triple};
+    int32_t levels[] = {1, 1, 2, 3};
+    for (int i = 0; i < 4 && rest > 0; i++) {
+        int64_t capacity = (levels[i] == 1) ? n : (levels[i] == 2) ? n * n : n * n * n;
+        if (inode_visit_block(fs, roots[i], levels[i], rest < capacity ? rest : capacity, operation) == false) {
+            return false;
+        }
+        rest -= capacity;
+    }
+
+    return true;
+}
+
+/**
+ * Vrátí, zda lze clustery i-nodu sdílet s další kopií souboru (počet referencí není na maximu).
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ *
+ * @return  true - clustery lze sdílet
+ *          false - některý cluster má už příliš mnoho kopií
+ */
+bool inode_clusters_shareable(FS *fs, PSEUDO_INODE *inode) {
+    return inode_visit_clusters(fs, inode, CLUSTERS_CHECK);
+}
+
+/**
+ * Přidá referenci všem clusterům i-nodu, včetně bloků odkazů - clustery začne sdílet kopie souboru.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ */
+void inode_share_clusters(FS *fs, PSEUDO_INODE *inode) {
+    inode_visit_clusters(fs, inode, CLUSTERS_REF);
+}
+
+/**
+ * Převede i-node z extentů na přímé a nepřímé odkazy. Clustery s daty zůstanou na svém místě,
+ * alokují se jen bloky odkazů.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node s extenty
+ *
+ * @return  true - i-node používá přímé a nepřímé odkazy
+ *          false - soubor je na odkazy příliš velký nebo nejsou volné clustery
+ */
+static bool inode_to_blocks(FS *fs, PSEUDO_INODE *inode) {
+    int32_t count = inode->count_clusters;
+    if (count > inode_max_clusters(fs) || fs->bitmap->free_count < inode_pointer_blocks(fs, count)) {
+        return false;
+    }
+
+    EXTENT extents[COUNT_EXTENTS];
+    memcpy(extents, inode->extents, sizeof(extents));
+
+    inode->isExtent = false;
+    for (int i = 0; i < COUNT_EXTENTS; i++) {
+        inode->extents[i].start = -1;
+        inode->extents[i].length = 0;
+    }
+    for (int i = 0; i < COUNT_DIRECT_LINK; i++) {
+        inode->directs[i] = -1;
+    }
+    inode->indirect1 = -1;
+    inode->indirect2 = -1;
+    inode->indirect_double = -1;
+    inode->indirect_triple = -1;
+    inode->count_clusters = 0;
+
+    // the clusters are linked again in the same order
+    for (int i = 0; i < COUNT_EXTENTS && extents[i].length > 0; i++) {
+        for (int j = 0; j < extents[i].length; j++) {
+            inode_append_link(fs, inode, extents[i].start + j);
+        }
+    }
+    write_inode_to_file(fs, inode);
+
+    return true;
+}
+
+/**
+ * Přidá cluster na konec i-nodu s extenty - prodlouží poslední extent, pokud je cluster za ním
+ * volný, jinak založí nový extent.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node s extenty
+ *
+ * @return  index přidaného clusteru
+ *          -1, pokud nejsou volné clustery ani extenty
+ */
+static int32_t inode_add_extent_cluster(FS *fs, PSEUDO_INODE *inode) {
+    int32_t n_of_extents = 0;
+    while (n_of_extents < COUNT_EXTENTS && inode->extents[n_of_extents].length > 0) {
+        n_of_extents++;
+    }
+
+    if (fs->bitmap->free_count == 0) {
+        return -1;
+    }
+
+    int32_t cluster = -1;
+    EXTENT *last = (n_of_extents > 0) ? &inode->extents[n_of_extents - 1] : NULL;
+    if (last != NULL && last->start + last->length < fs->superblock->cluster_count &&
+        bitmap_is_free(fs->bitmap, last->start + last->length) == true) {
+        cluster = last->start + last->length;
+        bitmap_set_used(fs, cluster);
+        last->length++;
+    } else if (n_of_extents < COUNT_EXTENTS) {
+        cluster = get_cluster(fs);
+        inode->extents[n_of_extents].start = cluster;
+        inode->extents[n_of_extents].length = 1;
+    } else {
+        return -1;
+    }
+
+    inode->count_clusters++;
+    write_inode_to_file(fs, inode);
+    return cluster;
+}
+
+/**
+ * Přidá na konec i-nodu nový cluster. Bloky odkazů (i dvojitě a trojitě nepřímých) se alokují, až když
+ * jsou potřeba.
+ * I-node s extenty roste po extentech, když dojdou, převede se na přímé a nepřímé odkazy.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru nebo adresáře
+ *
+ * @return  index přidaného clusteru
+ *          -1, pokud i-node nemá volný odkaz nebo nejsou volné clustery
+ */
+int32_t inode_add_cluster(FS *fs, PSEUDO_INODE *inode) {
+    int32_t index = inode->count_clusters;
+
+    if (inode->isExtent == true) {
+        int32_t cluster = inode_add_extent_cluster(fs, inode);
+        if (cluster != -1 || inode_to_blocks(fs, inode) == false) {
+            return cluster;
+        }
+    }
+    if (index >= inode_max_clusters(fs)) {
+        return -1;
+    }
+
+    // missing or shared blocks of links on the way cost one cluster each
+    if (fs->bitmap->free_count < 1 + inode_link_cost(fs, inode, index)) {
+        return -1;
+    }
+
+    int32_t cluster = get_cluster(fs);
+    inode_append_link(fs, inode, cluster);
+    return cluster;
+}
+
+/**
+ * Nahradí cluster s daným indexem jiným clusterem. Extent se rozdělí, pokud na to nestačí
+ * volné extenty, i-node se převede na přímé a nepřímé odkazy.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ * @param index - logický index clusteru v souboru
+ * @param cluster - nový cluster
+ *
+ * @return  true - odkaz byl změněn
+ *          false - jinak
+ */
+static bool inode_set_cluster(FS *fs, PSEUDO_INODE *inode, int32_t index, int32_t cluster) {
+    if (inode->isExtent == true) {
+        // the extent is split around the replaced cluster
+        EXTENT extents[COUNT_EXTENTS + 2];
+        int32_t n_of_extents = 0;
+        int32_t position = index;
+        for (int i = 0; i < COUNT_EXTENTS && inode->extents[i].length > 0; i++) {
+            EXTENT extent = inode->extents[i];
+            if (position < 0 || position >= extent.length) {
+                extents[n_of_extents++] = extent;
+                position -= extent.length;
+                continue;
+            }
+
+            if (position > 0) {
+                extents[n_of_extents++] = (EXTENT) {extent.start, position};
+            }
+            extents[n_of_extents++] = (EXTENT) {cluster, 1};
+            if (position + 1 < extent.length) {
+                extents[n_of_extents++] = (EXTENT) {extent.start + position + 1, extent.length - position - 1};
+            }
+            position = -1;
+        }
+
+        if (n_of_extents <= COUNT_EXTENTS) {
+            set_inode_extents(inode, extents, n_of_extents);
+            write_inode_to_file(fs, inode);
+            return true;
+        }
+        if (inode_to_blocks(fs, inode) == false) {
+            return false;
+        }
+    }
+
+    int32_t *link = inode_link(fs, inode, index);
+    if (link == NULL) {
+        return false;
+    }
+    *link = cluster;
+    io_mark_dirty(fs, link, sizeof(int32_t));
+
+    return true;
+}
+
+/**
+ * Vrátí cluster s daným indexem, do kterého lze zapisovat. Cluster sdílený s kopií souboru
+ * se nejdřív zkopíruje (copy-on-write) a odkaz se přesměruje na kopii.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ * @param index - logický index clusteru v souboru
+ *
+ * @return  index clusteru
+ *          -1, pokud cluster neexistuje nebo nejsou volné clustery
+ */
+int32_t inode_private_cluster(FS *fs, PSEUDO_INODE *inode, int32_t index) {
+    int32_t cluster = inode_get_cluster(fs, inode, index);
+    if (cluster == -1 || cluster_is_shared(fs, cluster) == false) {
+        return cluster;
+    }
+
+    int32_t copy = cluster_make_private(fs, cluster);
+    if (copy == -1) {
+        return -1;
+    }
+
+    // the link stays on the shared cluster
+    if (inode_set_cluster(fs, inode, index, copy) == false) {
+        bitmap_set_free(fs, copy);
+        cluster_ref(fs, cluster);
+        return -1;
+    }
+
+    return copy;
+}
+
+/**
+ * Přečte část souboru. Pozice se převede přímo na cluster přes přímé a nepřímé odkazy (nebo extenty),
+ * čtou se jen clustery v rozsahu.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ * @param buffer - buffer pro data
+ * @param offset - pozice v souboru
+ * @param length - maximální počet bajtů
+ *
+ * @return počet přečtených bajtů, 0 = konec souboru
+ */
+int64_t inode_read(FS *fs, PSEUDO_INODE *inode, void *buffer, int64_t offset, int64_t length) {
+    int32_t cluster_size = fs->superblock->cluster_size;
+
+    if (offset >= inode->file_size) {
+        return 0;
+    }
+    if (length > inode->file_size - offset) {
+        length = inode->file_size - offset;
+    }
+
+    int64_t done = 0;
+    while (done < length) {
+        int64_t position = offset + done;
+        int32_t cluster = inode_get_cluster(fs, inode, (int32_t) (position / cluster_size));
+        if (cluster == -1) {
             break;
         }
+
+        int64_t in_cluster = position % cluster_size;
+        int64_t bytes = cluster_size - in_cluster < length - done ? cluster_size - in_cluster : length - done;
+        memcpy((char *) buffer + done, cluster_ptr(fs, cluster) + in_cluster, (size_t) bytes);
+        done += bytes;
     }
-    fflush(fs->FILE);
+    io_count_read((size_t) done);
 
-    // indirect links
-    if (n_of_indirects == 1) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (new_inode->indirect1 * fs->superblock->cluster_size), SEEK_SET);
-        fwrite(clusters, sizeof(int32_t), cluster_overflow, fs->FILE);
-    } else if (n_of_indirects == 2) {
-        fseek(fs->FILE, fs->superblock->data_start_address + (new_inode->indirect1 * fs->superblock->cluster_size), SEEK_SET);
-        fwrite(clusters, sizeof(int32_t), n_of_ints_in_clusters, fs->FILE);
+    return done;
+}
 
-        int32_t data_links[cluster_overflow - n_of_ints_in_clusters];
-        int index = 0;
-        for (int i = n_of_ints_in_clusters; i <= n_of_ints_in_clusters + (cluster_overflow - n_of_ints_in_clusters); ++i) {
-            data_links[index] = clusters[i];
-            index++;
+/**
+ * Zapíše data do existujících clusterů souboru, sdílené clustery se před zápisem zkopírují.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ * @param buffer - data, NULL = zapisují se nuly
+ * @param offset - pozice v souboru
+ * @param length - počet bajtů
+ *
+ * @return  true - data jsou zapsána
+ *          false - pro kopii sdíleného clusteru není místo
+ */
+static bool inode_copy_in(FS *fs, PSEUDO_INODE *inode, const char *buffer, int64_t offset, int64_t length) {
+    int32_t cluster_size = fs->superblock->cluster_size;
+
+    int64_t done = 0;
+    while (done < length) {
+        int64_t position = offset + done;
+        int32_t cluster = inode_private_cluster(fs, inode, (int32_t) (position / cluster_size));
+        if (cluster == -1) {
+            return false;
         }
 
-        fflush(fs->FILE);
-        fseek(fs->FILE, fs->superblock->data_start_address + (new_inode->indirect2 * fs->superblock->cluster_size), SEEK_SET);
+        int64_t in_cluster = position % cluster_size;
+        int64_t bytes = cluster_size - in_cluster < length - done ? cluster_size - in_cluster : length - done;
+        char *data = cluster_ptr(fs, cluster) + in_cluster;
+        if (buffer == NULL) {
+            // a hole (never written or punched cluster) already reads as zeros and stays a hole
+            if (data[0] == 0 && memcmp(data, data + 1, (size_t) bytes - 1) == 0) {
+                done += bytes;
+                continue;
+            }
+            memset(data, 0, (size_t) bytes);
+        } else {
+            memcpy(data, buffer + done, (size_t) bytes);
+        }
+        io_mark_data(fs, data, (size_t) bytes);
+        done += bytes;
+    }
 
-        fwrite(data_links, sizeof(int32_t), (cluster_overflow - n_of_ints_in_clusters), fs->FILE);
+    return true;
+}
+
+/**
+ * Zapíše data na danou pozici souboru. Přepisuje se na místě, za konec souboru se přidají jen
+ * chybějící clustery. Mezera mezi koncem souboru a pozicí se vyplní nulami.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node souboru
+ * @param buffer - data
+ * @param offset - pozice v souboru
+ * @param length - počet bajtů
+ *
+ * @return počet zapsaných bajtů, -1 = nejsou volné clustery nebo je soubor příliš velký
+ */
+int64_t inode_write(FS *fs, PSEUDO_INODE *inode, const void *buffer, int64_t offset, int64_t length) {
+    int32_t cluster_size = fs->superblock->cluster_size;
+    int64_t end = offset + length;
+
+    if (length == 0) {
+        return 0;
     }
 
-    fflush(fs->FILE);
+    // clusters behind the end of the file, the ones added before a failure stay as unused space
+    int64_t n_of_clusters = (end + cluster_size - 1) / cluster_size;
+    if (n_of_clusters > INT32_MAX) {
+        return -1;
+    }
+    while (inode->count_clusters < n_of_clusters) {
+        if (inode_add_cluster(fs, inode) == -1) {
+            return -1;
+        }
+    }
 
-    // free memory
-    for (int i = 0; i < new_inode->count_clusters; i++) {
-        char *currentIntPtr = buffer[i];
-        free(currentIntPtr);
+    if (offset > inode->file_size && inode_copy_in(fs, inode, NULL, inode->file_size,
+                                                   offset - inode->file_size) == false) {
+        return -1;
     }
-    free(buffer);
+    if (inode_copy_in(fs, inode, buffer, offset, length) == false) {
+        return -1;
+    }
+
+    if (end > inode->file_size) {
+        inode->file_size = end;
+        write_inode_to_file(fs, inode);
+    }
+
+    return length;
 }
 
 /**
@@ -611,10 +1465,10 @@ void write_clusters_to_file(FS *fs, PSEUDO_INODE *new_inode, int32_t *clusters,
  *
  * @param path aktuaální cesta
  *
- * @return cesta k rodiči
+ * @return cesta k rodiči v areně příkazu
  */
 char *get_path_to_parent(char *path){
-    char *temp_path_to_parent = calloc(PATH_MAX, sizeof(char));
+    char *temp_path_to_parent = arena_alloc(PATH_MAX);
 
     if (path[0] == '.' && path[1] == '/') {
         int32_t index = 2;
@@ -650,42 +1504,15 @@ char *get_path_to_parent(char *path){
  * @return  true - smazání proběhlo úšpěšně
  *          false - jinak
  */
-bool delete_inode(FS *fs, PSEUDO_INODE *inode) {
-    int index = 0;
-    bool result = false;
-
-    fs->FILE = fopen(fs->filename, "rb+");
-
+bool delete_inode(FS *fs, PSEUDO_INODE *inode, char *name) {
     // get parent
     INODES *inodes = fs->inodes;
     PSEUDO_INODE *parent_inode = &inodes->data[inode->parent_id];
 
-    // load parent directory items
-    DIRECTORY_ITEMS *parent_dir = read_directory_items_from_file(fs, parent_inode);
-
-    DIRECTORY_ITEM *tmp_item = calloc(sizeof(DIRECTORY_ITEM), parent_dir->size);
-
-    for (int j = 0; j < parent_dir->size; j++) {
-        if (inode->node_id != parent_dir->data[j].node_id) {
-            tmp_item[index].node_id = parent_dir->data[j].node_id;
-            strcpy(tmp_item[index].item_name, parent_dir->data[j].item_name);
-            index++;
-            result = true;
-        }
-    }
-
+    // remove the item from the parent's hashed table
+    bool result = directory_remove(fs, parent_inode, name);
     if (result == true) {
-        parent_dir->size--;
-        parent_dir->data = tmp_item;
-
-        // write to file
-        write_directory_items_to_file(fs, parent_dir, parent_inode);
-
-        // free
-        free_directory_items(parent_dir);
-        parent_dir = NULL;
-        free(tmp_item);
-        tmp_item = NULL;
+        cache_invalidate_directory(fs, inode->node_id);
     } else {
         printf("Error deleting i-node.\n");
     }
@@ -693,6 +1520,24 @@ bool delete_inode(FS *fs, PSEUDO_INODE *inode) {
     return result;
 }
 
+/**
+ * Uvolní clustery i-nodu a samotný i-node. Sdílené clustery přijdou jen o jednu referenci,
+ * uvolní je až poslední vlastník. I-node už nesmí být v žádném adresáři.
+ *
+ * @param fs - struktura file systému
+ * @param inode - i-node k uvolnění
+ */
+void release_inode(FS *fs, PSEUDO_INODE *inode) {
+    inode_visit_clusters(fs, inode, CLUSTERS_UNREF);
+
+    int32_t directs[COUNT_DIRECT_LINK];
+    for (int j = 0; j < COUNT_DIRECT_LINK; j++) {
+        directs[j] = -1;
+    }
+
+    init_pseudoinode(fs, inode->node_id, -1, true, false, -1, -1, directs, -1, -1);
+}
+
 PSEUDO_INODE *get_parent_inode(FS *fs, PSEUDO_INODE *inode) {
     return &fs->inodes->data[inode->parent_id];
 }
@@ -717,14 +1562,16 @@ PSEUDO_INODE * init_slink(FS *fs, int32_t id_node, int32_t parent_id, int32_t li
     inode->isDirectory = false;
     inode->isSLink = true;
     inode->file_size = 0;
-    inode->is_free = false;
     inode->count_clusters = 0;
     for (int j = 0; j < COUNT_DIRECT_LINK; j++) {
         inode->directs[j] = directs[j];
     }
     inode->indirect1 = -1;
     inode->indirect2 = -1;
+    inode->indirect_double = -1;
+    inode->indirect_triple = -1;
 
+    set_inode_free(fs, inode, false);
     return inode;
 }
 
@@ -13,10 +13,26 @@
 
 
 PSEUDO_INODE *get_free_inode(FS *fs);
-INODES *inodes_init(int32_t count);
+void set_inode_free(FS *fs, PSEUDO_INODE *inode, bool is_free);
+INODES *inodes_init(FS *fs, int32_t count);
 int32_t  get_cluster(FS *fs);
+int32_t inode_max_clusters(FS *fs);
+int32_t inode_pointer_blocks(FS *fs, int32_t count);
+int32_t inode_get_cluster(FS *fs, PSEUDO_INODE *inode, int32_t index);
+void cluster_iterator_init(CLUSTER_ITERATOR *iterator, PSEUDO_INODE *inode);
+int32_t cluster_iterator_next(FS *fs, CLUSTER_ITERATOR *iterator);
+bool cluster_iterator_next_run(FS *fs, CLUSTER_ITERATOR *iterator, EXTENT *run);
+bool inode_clusters_shareable(FS *fs, PSEUDO_INODE *inode);
+void inode_share_clusters(FS *fs, PSEUDO_INODE *inode);
+int32_t inode_add_cluster(FS *fs, PSEUDO_INODE *inode);
+int32_t inode_private_cluster(FS *fs, PSEUDO_INODE *inode, int32_t index);
+int64_t inode_read(FS *fs, PSEUDO_INODE *inode, void *buffer, int64_t offset, int64_t length);
+int64_t inode_write(FS *fs, PSEUDO_INODE *inode, const void *buffer, int64_t offset, int64_t length);
+int32_t get_extents(FS *fs, int32_t count, EXTENT extents[COUNT_EXTENTS]);
 void write_inodes_to_file(FS *fs);
+void write_inode_to_file(FS *fs, PSEUDO_INODE *inode);
 void print_inodes(INODES *inodes);
+void print_extents(PSEUDO_INODE *inode);
 
 PSEUDO_INODE *get_inode(FS *fs, char *path, int32_t type);
 PSEUDO_INODE *search_for_inode(FS *fs, PSEUDO_INODE *start_inode, char *path, bool search_from_current_node);
@@ -27,14 +43,15 @@ bool contains_char(char *string, char pattern);
 char *get_filename_from_path(char *path);
 int32_t get_last_index_of_slash(char *string, char pattern);
 
-PSEUDO_INODE *init_pseudoinode(FS *fs, int32_t id_node, int32_t parent_id, bool isFree, bool isDirectory, int32_t file_size,
+PSEUDO_INODE *init_pseudoinode(FS *fs, int32_t id_node, int32_t parent_id, bool isFree, bool isDirectory, int64_t file_size,
                  int32_t count_clusters,
                  int32_t directs[COUNT_DIRECT_LINK], int32_t indirect1, int32_t indirect2);
 
-void write_clusters_to_file(FS *fs, PSEUDO_INODE *new_inode, int32_t *clusters, char **buffer);
+void set_inode_extents(PSEUDO_INODE *inode, EXTENT *extents, int32_t n_of_extents);
 char *get_path_to_parent(char *path);
 
-bool delete_inode(FS *fs, PSEUDO_INODE *inode);
+bool delete_inode(FS *fs, PSEUDO_INODE *inode, char *name);
+void release_inode(FS *fs, PSEUDO_INODE *inode);
 PSEUDO_INODE *get_parent_inode(FS *fs, PSEUDO_INODE *inode);
 
 void read_inodes_from_file(FS *fs);
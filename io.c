@@ -0,0 +1,593 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "header.h"
+#include "io.h"
+#include "journal.h"
+#include "stats.h"
+
+/**
+ * Připraví (nebo zvětší) bitmapy změněných stránek mapování. Nové stránky jsou čisté.
+ *
+ * @param fs - struktura file systému
+ * @param old_size - předchozí velikost mapování
+ */
+static void io_dirty_resize(FS *fs, size_t old_size) {
+    fs->page_size = sysconf(_SC_PAGESIZE);
+
+    size_t old_words = BITMAP_WORDS((old_size + fs->page_size - 1) / fs->page_size);
+    size_t n_of_words = BITMAP_WORDS((fs->map_size + fs->page_size - 1) / fs->page_size);
+
+    fs->dirty_pages = realloc(fs->dirty_pages, n_of_words * sizeof(uint64_t));
+    fs->meta_pages = realloc(fs->meta_pages, n_of_words * sizeof(uint64_t));
+    if (n_of_words > old_words) {
+        memset(fs->dirty_pages + old_words, 0, (n_of_words - old_words) * sizeof(uint64_t));
+        memset(fs->meta_pages + old_words, 0, (n_of_words - old_words) * sizeof(uint64_t));
+    }
+}
+
+/**
+ * Otevře soubor file systému a namapuje jej do paměti. Soubor zůstává otevřený a namapovaný
+ * až do zavolání io_close. Mapování je soukromé, do souboru se změny dostanou jen přes io_flush
+ * (metadata nejdřív do žurnálu), takže pád uprostřed příkazu soubor nepoškodí.
+ *
+ * @param fs - struktura file systému
+ * @param size - velikost souboru, při otevírání existujícího souboru 0 = ponechat aktuální velikost
+ * @param create - true - vytvoří nový (prázdný) soubor, false - otevře existující
+ *
+ * @return  true - soubor je namapovaný
+ *          false - soubor nelze otevřít nebo namapovat
+ */
+bool io_open(FS *fs, size_t size, bool create) {
+    if (create == true) {
+        fs->fd = open(fs->filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    } else {
+        fs->fd = open(fs->filename, O_RDWR);
+    }
+
+    if (fs->fd == -1) {
+        return false;
+    }
+
+    // keep the current size of an existing image
+    if (size == 0) {
+        struct stat file_stat;
+        if (fstat(fs->fd, &file_stat) == -1 || file_stat.st_size == 0) {
+            close(fs->fd);
+            fs->fd = -1;
+            return false;
+        }
+        size = file_stat.st_size;
+    } else if (ftruncate(fs->fd, size) == -1) {
+        close(fs->fd);
+        fs->fd = -1;
+        return false;
+    }
+
+    fs->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fs->fd, 0);
+    if (fs->map == MAP_FAILED) {
+        fs->map = NULL;
+        close(fs->fd);
+        fs->fd = -1;
+        return false;
+    }
+    fs->map_size = size;
+    io_dirty_resize(fs, 0);
+
+    return true;
+}
+
+/**
+ * Změní velikost souboru file systému a namapuje jej znovu. Ukazatele do původního mapování
+ * přestávají platit.
+ *
+ * @param fs - struktura file systému
+ * @param size - nová velikost souboru
+ *
+ * @return  true - úspěch
+ *          false - jinak
+ */
+bool io_resize(FS *fs, size_t size) {
+    if (ftruncate(fs->fd, size) == -1) {
+        return false;
+    }
+
+    char *map = mremap(fs->map, fs->map_size, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    size_t old_size = fs->map_size;
+    fs->map = map;
+    fs->map_size = size;
+    io_dirty_resize(fs, old_size);
+    return true;
+}
+
+/**
+ * Zapíše neuložené změny, zruší mapování a zavře soubor.
+ *
+ * @param fs - struktura file systému
+ */
+void io_close(FS *fs) {
+    if (fs->map != NULL) {
+        // an image that failed to load is left as it is
+        if (fs->superblock != NULL) {
+            io_flush(fs);
+            journal_close(fs);
+        }
+        munmap(fs->map, fs->map_size);
+        fs->map = NULL;
+        fs->map_size = 0;
+    }
+    free(fs->dirty_pages);
+    free(fs->meta_pages);
+    fs->dirty_pages = NULL;
+    fs->meta_pages = NULL;
+    free(fs->converted_superblock);
+    fs->converted_superblock = NULL;
+    free(fs->freed_clusters);
+    fs->freed_clusters = NULL;
+    fs->n_of_freed_clusters = 0;
+    if (fs->fd != -1) {
+        close(fs->fd);
+        fs->fd = -1;
+    }
+}
+
+/**
+ * Označí stránky úseku mapování v bitmapě stránek.
+ *
+ * @param fs - struktura file systému
+ * @param pages - bitmapa stránek
+ * @param ptr - začátek úseku v mapování
+ * @param length - délka úseku
+ *
+ * @return počet nově označených stránek
+ */
+static size_t io_mark_pages(FS *fs, uint64_t *pages, void *ptr, size_t length) {
+    size_t offset = (char *) ptr - fs->map;
+    size_t first = offset / fs->page_size;
+    size_t last = (offset + length - 1) / fs->page_size;
+    size_t n_of_marked = 0;
+
+    for (size_t page = first; page <= last; page++) {
+        uint64_t mask = UINT64_C(1) << (page % BITMAP_WORD_BITS);
+        if ((pages[page / BITMAP_WORD_BITS] & mask) == 0) {
+            pages[page / BITMAP_WORD_BITS] |= mask;
+            n_of_marked++;
+        }
+    }
+
+    return n_of_marked;
+}
+
+/**
+ * Označí změněná metadata. Změněné stránky zapíše io_flush na konci příkazu přes žurnál.
+ *
+ * @param fs - struktura file systému
+ * @param ptr - začátek změněného úseku v mapování
+ * @param length - délka úseku
+ */
+void io_mark_dirty(FS *fs, void *ptr, size_t length) {
+    if (fs->map == NULL || length == 0) {
+        return;
+    }
+
+    io_mark_pages(fs, fs->dirty_pages, ptr, length);
+    fs->dirty_meta_pages += io_mark_pages(fs, fs->meta_pages, ptr, length);
+}
+
+/**
+ * Vrátí, zda by neuložená metadata měla jít do souboru hned, i když příkaz (dávka příkazů)
+ * ještě neskončil - jejich transakce by jinak zabrala víc než polovinu žurnálu.
+ *
+ * @param fs - struktura file systému
+ *
+ * @return  true - je čas zavolat io_flush
+ *          false - metadata mohou počkat
+ */
+bool io_should_flush(FS *fs) {
+    return fs->dirty_meta_pages * (fs->page_size + sizeof(JOURNAL_RECORD)) >= (size_t) fs->superblock->journal_size / 2;
+}
+
+/**
+ * Označí změněná data souboru. Data se do žurnálu nezapisují, jdou rovnou na své místo ještě
+ * před metadaty, která na ně odkazují. Volá se až po zápisu dat do mapování.
+ *
+ * @param fs - struktura file systému
+ * @param ptr - začátek změněného úseku v mapování
+ * @param length - délka úseku
+ */
+void io_mark_data(FS *fs, void *ptr, size_t length) {
+    if (fs->map == NULL || length == 0) {
+        return;
+    }
+
+    fs->dirty_data_pages += io_mark_pages(fs, fs->dirty_pages, ptr, length);
+
+    // big files don't pile up in private pages of the mapping
+    if (fs->dirty_data_pages * fs->page_size >= IO_CHUNK_SIZE) {
+        io_flush_data(fs);
+    }
+}
+
+/**
+ * Označí cluster jako uvolněný (nebo znovu obsazený) od posledního io_flush. Do uvolněných
+ * clusterů io_flush vyrazí díru v souboru, až bude jejich uvolnění zapsané v žurnálu.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index clusteru
+ * @param is_freed - true - cluster byl uvolněn, false - cluster byl obsazen
+ */
+void io_mark_freed(FS *fs, int32_t cluster, bool is_freed) {
+    if (fs->freed_clusters == NULL) {
+        if (is_freed == false) {
+            return;
+        }
+        fs->freed_clusters = calloc(BITMAP_WORDS(fs->superblock->cluster_count), sizeof(uint64_t));
+        if (fs->freed_clusters == NULL) {
+            return;
+        }
+    }
+
+    uint64_t *word = &fs->freed_clusters[cluster / BITMAP_WORD_BITS];
+    uint64_t mask = UINT64_C(1) << (cluster % BITMAP_WORD_BITS);
+    if (is_freed == true && (*word & mask) == 0) {
+        *word |= mask;
+        fs->n_of_freed_clusters++;
+    } else if (is_freed == false && (*word & mask) != 0) {
+        // reused before the hole was punched, the new data must stay
+        *word &= ~mask;
+        fs->n_of_freed_clusters--;
+    }
+}
+
+/**
+ * Vyrazí díry do souboru FS na místě clusterů uvolněných od posledního io_flush, volné clustery
+ * tak nezabírají místo na disku a neobsahují stará data. Souvislé úseky clusterů jdou jedním voláním.
+ *
+ * @param fs - struktura file systému
+ */
+static void io_punch_freed(FS *fs) {
+    if (fs->n_of_freed_clusters == 0) {
+        return;
+    }
+
+    int32_t cluster_size = fs->superblock->cluster_size;
+    int32_t count = fs->superblock->cluster_count;
+    int32_t cluster = 0;
+    while (cluster < count) {
+        if (fs->freed_clusters[cluster / BITMAP_WORD_BITS] == 0) {
+            cluster = (cluster / BITMAP_WORD_BITS + 1) * BITMAP_WORD_BITS;
+            continue;
+        }
+        if (((fs->freed_clusters[cluster / BITMAP_WORD_BITS] >> (cluster % BITMAP_WORD_BITS)) & 1) == 0) {
+            cluster++;
+            continue;
+        }
+
+        int32_t start = cluster;
+        while (cluster < count && ((fs->freed_clusters[cluster / BITMAP_WORD_BITS] >> (cluster % BITMAP_WORD_BITS)) & 1)) {
+            cluster++;
+        }
+
+        size_t offset = fs->superblock->data_start_address + (int64_t) start * cluster_size;
+        size_t length = (size_t) (cluster - start) * cluster_size;
+        fallocate(fs->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length);
+
+        // private copies of the punched pages would differ from the file
+        if (offset % fs->page_size == 0 && length % fs->page_size == 0) {
+            madvise(fs->map + offset, length, MADV_DONTNEED);
+        }
+    }
+
+    memset(fs->freed_clusters, 0, BITMAP_WORDS(count) * sizeof(uint64_t));
+    fs->n_of_freed_clusters = 0;
+}
+
+/**
+ * Vrátí, zda úsek mapování obsahuje změněnou stránku, kterou io_flush ještě nezapsal.
+ *
+ * @param fs - struktura file systému
+ * @param offset - pozice úseku
+ * @param length - délka úseku
+ *
+ * @return  true - úsek obsahuje změněnou stránku
+ *          false - úsek je v souboru aktuální
+ */
+static bool io_range_dirty(FS *fs, size_t offset, size_t length) {
+    for (size_t page = offset / fs->page_size; page * fs->page_size < offset + length; page++) {
+        if ((fs->dirty_pages[page / BITMAP_WORD_BITS] >> (page % BITMAP_WORD_BITS)) & 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Zjistí, zda úsek souboru FS od dané pozice začíná dírou (do clusteru se nikdy nezapsalo, nebo
+ * byl uvolněn), nebo daty, a vrátí délku této části.
+ *
+ * @param fs - struktura file systému
+ * @param offset - pozice úseku v souboru
+ * @param length - délka úseku
+ * @param is_hole - výstup, true - část je díra (čte se jako nuly), false - část obsahuje data
+ *
+ * @return délka části úseku stejného druhu, nejvýše length
+ */
+size_t io_extent_at(FS *fs, size_t offset, size_t length, bool *is_hole) {
+    // without SEEK_DATA everything is data
+    off_t data = lseek(fs->fd, (off_t) offset, SEEK_DATA);
+    stats.io.seeks++;
+    if (data == -1) {
+        *is_hole = (errno == ENXIO);
+    } else if ((size_t) data > offset) {
+        *is_hole = true;
+        if ((size_t) data - offset < length) {
+            length = (size_t) data - offset;
+        }
+    } else {
+        *is_hole = false;
+        off_t hole = lseek(fs->fd, (off_t) offset, SEEK_HOLE);
+        stats.io.seeks++;
+        if (hole != -1 && (size_t) hole > offset && (size_t) hole - offset < length) {
+            length = (size_t) hole - offset;
+        }
+    }
+
+    // data not flushed yet are only in the mapping
+    if (*is_hole == true && io_range_dirty(fs, offset, length) == true) {
+        *is_hole = false;
+    }
+    return length;
+}
+
+/**
+ * Najde další souvislý úsek změněných stránek daného druhu.
+ *
+ * @param fs - struktura file systému
+ * @param meta - true = stránky s metadaty, false = stránky jen s daty souborů
+ * @param page - vstup/výstup, stránka, od které se hledá; po návratu stránka za nalezeným úsekem
+ * @param offset - výstup, pozice úseku v souboru
+ * @param length - výstup, délka úseku v bajtech
+ *
+ * @return  true - úsek byl nalezen
+ *          false - žádný další úsek není
+ */
+bool io_next_dirty_run(FS *fs, bool meta, size_t *page, size_t *offset, size_t *length) {
+    size_t n_of_pages = (fs->map_size + fs->page_size - 1) / fs->page_size;
+    size_t first = *page;
+    size_t last;
+
+    // first page of the run
+    while (first < n_of_pages) {
+        uint64_t dirty = fs->dirty_pages[first / BITMAP_WORD_BITS];
+        if (dirty == 0) {
+            first = (first / BITMAP_WORD_BITS + 1) * BITMAP_WORD_BITS;
+            continue;
+        }
+        uint64_t mask = UINT64_C(1) << (first % BITMAP_WORD_BITS);
+        bool is_meta = (fs->meta_pages[first / BITMAP_WORD_BITS] & mask) != 0;
+        if ((dirty & mask) != 0 && is_meta == meta) {
+            break;
+        }
+        first++;
+    }
+    if (first >= n_of_pages) {
+        *page = n_of_pages;
+        return false;
+    }
+
+    // the run ends with the first page of a different kind
+    for (last = first + 1; last < n_of_pages; last++) {
+        uint64_t mask = UINT64_C(1) << (last % BITMAP_WORD_BITS);
+        bool is_dirty = (fs->dirty_pages[last / BITMAP_WORD_BITS] & mask) != 0;
+        bool is_meta = (fs->meta_pages[last / BITMAP_WORD_BITS] & mask) != 0;
+        if (is_dirty == false || is_meta != meta) {
+            break;
+        }
+    }
+
+    *page = last;
+    *offset = first * fs->page_size;
+    *length = (last - first) * fs->page_size;
+
+    // the last page may be only partially mapped
+    if (*offset + *length > fs->map_size) {
+        *length = fs->map_size - *offset;
+    }
+    return true;
+}
+
+/**
+ * Zapíše úsek mapování na jeho místo v souboru.
+ *
+ * @param fs - struktura file systému
+ * @param offset - pozice úseku
+ * @param length - délka úseku
+ *
+ * @return  true - úsek byl zapsán
+ *          false - chyba zápisu
+ */
+bool io_write_range(FS *fs, size_t offset, size_t length) {
+    return io_pwrite(fs, fs->map + offset, offset, length);
+}
+
+/**
+ * Zapíše buffer do souboru FS na danou pozici, včetně částečných zápisů.
+ *
+ * @param fs - struktura file systému
+ * @param buffer - data
+ * @param offset - pozice v souboru
+ * @param length - délka dat
+ *
+ * @return  true - data byla zapsána
+ *          false - chyba zápisu
+ */
+bool io_pwrite(FS *fs, const void *buffer, size_t offset, size_t length) {
+    const char *data = buffer;
+
+    while (length > 0) {
+        ssize_t written = pwrite(fs->fd, data, length, offset);
+        stats.io.writes++;
+        if (written <= 0) {
+            printf("ERROR WRITING FS FILE\n");
+            return false;
+        }
+        stats.io.bytes_written += written;
+        data += written;
+        offset += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * Vynuluje bitmapy změněných stránek v úseku.
+ *
+ * @param fs - struktura file systému
+ * @param offset - pozice úseku
+ * @param length - délka úseku
+ */
+static void io_clear_run(FS *fs, size_t offset, size_t length) {
+    for (size_t page = offset / fs->page_size; page * fs->page_size < offset + length; page++) {
+        uint64_t mask = UINT64_C(1) << (page % BITMAP_WORD_BITS);
+        fs->dirty_pages[page / BITMAP_WORD_BITS] &= ~mask;
+        fs->meta_pages[page / BITMAP_WORD_BITS] &= ~mask;
+    }
+}
+
+/**
+ * Zapíše na místo stránky, které obsahují jen data souborů, a uvolní jejich soukromé kopie
+ * v mapování (další přístup je načte ze souboru). Bez fsync, ten udělá io_flush.
+ *
+ * @param fs - struktura file systému
+ */
+void io_flush_data(FS *fs) {
+    size_t page = 0;
+    size_t offset;
+    size_t length;
+
+    while (io_next_dirty_run(fs, false, &page, &offset, &length) == true) {
+        if (io_write_range(fs, offset, length) == true) {
+            madvise(fs->map + offset, length, MADV_DONTNEED);
+            io_clear_run(fs, offset, length);
+        }
+    }
+    fs->dirty_data_pages = 0;
+}
+
+/**
+ * Zapíše změny příkazu do souboru. Nejdřív data souborů na jejich místo, pak změněná metadata
+ * jednou transakcí do žurnálu s jediným fsync a nakonec metadata na jejich místo. Volá se jednou
+ * na konci každého příkazu.
+ *
+ * @param fs - struktura file systému
+ */
+void io_flush(FS *fs) {
+    if (fs->map == NULL) {
+        return;
+    }
+
+    // metadata may point to the data, so the data go first
+    io_flush_data(fs);
+
+    size_t page = 0;
+    size_t offset;
+    size_t length;
+    if (io_next_dirty_run(fs, true, &page, &offset, &length) == false) {
+        return;
+    }
+
+    // without the transaction the metadata are synced in place, an older transaction left in the journal
+    // would be replayed over them, so the journal is emptied before they are written
+    int32_t journaled = journal_commit(fs);
+    if (journaled == JOURNAL_FAILED) {
+        fprintf(stderr, "Error: Journal can't be written, metadata are written without it.\n");
+    }
+    if (journaled != JOURNAL_COMMITTED && journal_invalidate(fs) == false) {
+        fprintf(stderr, "Error: Journal can't be emptied.\n");
+    }
+
+    page = 0;
+    while (io_next_dirty_run(fs, true, &page, &offset, &length) == true) {
+        if (io_write_range(fs, offset, length) == true) {
+            io_clear_run(fs, offset, length);
+        }
+    }
+
+    fs->dirty_meta_pages = 0;
+
+    if (journaled != JOURNAL_COMMITTED && io_sync(fs) == false) {
+        fprintf(stderr, "Error: Metadata can't be synced.\n");
+    }
+
+    // the clusters are free in the journal now, a crash can't bring back the links to them
+    io_punch_freed(fs);
+}
+
+/**
+ * Počká, až budou zapsaná data souboru FS na disku (fdatasync).
+ *
+ * @param fs - struktura file systému
+ *
+ * @return  true - data jsou na disku
+ *          false - chyba zápisu
+ */
+bool io_sync(FS *fs) {
+    stats.io.syncs++;
+    return fdatasync(fs->fd) == 0;
+}
+
+/**
+ * Započítá do statistik data souborů přečtená z mapování. Čtení jde přímo z paměti, bez volání
+ * read, proto se počítá zvlášť.
+ *
+ * @param length - počet přečtených bajtů
+ */
+void io_count_read(size_t length) {
+    stats.io.bytes_read += length;
+}
+
+/**
+ * Vrátí ukazatel do namapovaného souboru.
+ *
+ * @param fs - struktura file systému
+ * @param offset - pozice v souboru
+ *
+ * @return ukazatel na danou pozici
+ */
+char *io_ptr(FS *fs, size_t offset) {
+    return fs->map + offset;
+}
+
+/**
+ * Vrátí ukazatel na začátek datového bloku v namapovaném souboru.
+ *
+ * @param fs - struktura file systému
+ * @param cluster - index datového bloku
+ *
+ * @return ukazatel na data clusteru
+ */
+char *cluster_ptr(FS *fs, int32_t cluster) {
+    return fs->map + fs->superblock->data_start_address + (int64_t) cluster * fs->superblock->cluster_size;
+}
+
+/**
+ * Vrátí celkovou velikost souboru file systému - metadata a všechny datové bloky.
+ *
+ * @param superblock - struktura superblocku
+ *
+ * @return velikost souboru v bajtech
+ */
+size_t image_size(SUPERBLOCK *superblock) {
+    return superblock->data_start_address + (int64_t) superblock->cluster_count * superblock->cluster_size;
+}
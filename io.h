@@ -0,0 +1,26 @@
+#ifndef ZOS_IO_H
+#define ZOS_IO_H
+
+#include "header.h"
+
+bool io_open(FS *fs, size_t size, bool create);
+bool io_resize(FS *fs, size_t size);
+void io_close(FS *fs);
+void io_mark_dirty(FS *fs, void *ptr, size_t length);
+void io_mark_data(FS *fs, void *ptr, size_t length);
+void io_mark_freed(FS *fs, int32_t cluster, bool is_freed);
+size_t io_extent_at(FS *fs, size_t offset, size_t length, bool *is_hole);
+bool io_should_flush(FS *fs);
+bool io_next_dirty_run(FS *fs, bool meta, size_t *page, size_t *offset, size_t *length);
+bool io_write_range(FS *fs, size_t offset, size_t length);
+bool io_pwrite(FS *fs, const void *buffer, size_t offset, size_t length);
+void io_flush_data(FS *fs);
+void io_flush(FS *fs);
+bool io_sync(FS *fs);
+void io_count_read(size_t length);
+
+char *io_ptr(FS *fs, size_t offset);
+char *cluster_ptr(FS *fs, int32_t cluster);
+size_t image_size(SUPERBLOCK *superblock);
+
+#endif //ZOS_IO_H
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "header.h"
+#include "journal.h"
+#include "io.h"
+
+/**
+ * Vrátí velikost žurnálu metadat pro disk dané velikosti (1/64 disku v mezích
+ * JOURNAL_MIN_SIZE a JOURNAL_MAX_SIZE, zarovnaná na JOURNAL_ALIGNMENT).
+ *
+ * @param disk_size - velikost disku
+ *
+ * @return velikost žurnálu v bajtech
+ */
+int64_t journal_size(int64_t disk_size) {
+    int64_t size = disk_size / 64;
+
+    if (size < JOURNAL_MIN_SIZE) {
+        size = JOURNAL_MIN_SIZE;
+    } else if (size > JOURNAL_MAX_SIZE) {
+        size = JOURNAL_MAX_SIZE;
+    }
+
+    return ALIGN_UP(size, JOURNAL_ALIGNMENT);
+}
+
+/**
+ * Spočítá kontrolní součet záznamů transakce (FNV-1a).
+ *
+ * @param data - záznamy transakce
+ * @param length - délka záznamů
+ *
+ * @return kontrolní součet
+ */
+static uint32_t journal_checksum(const char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Zapíše změněná metadata příkazu jako jednu transakci na konec žurnálu a zavolá jediný fsync.
+ * Na místo se metadata zapisují až potom (io_flush), bez dalšího fsync - zajistí ho fsync
+ * následující transakce, proto se při obnově přehrává jen poslední platná transakce.
+ *
+ * @param fs - struktura file systému
+ *
+ * @return  JOURNAL_COMMITTED - transakce je v žurnálu na disku
+ *          JOURNAL_TOO_BIG - transakce se do žurnálu nevejde
+ *          JOURNAL_FAILED - transakci nelze zapsat nebo synchronizovat
+ */
+int32_t journal_commit(FS *fs) {
+    size_t page = 0;
+    size_t offset;
+    size_t length;
+
+    // size of the transaction
+    size_t transaction_length = sizeof(JOURNAL_TRANSACTION);
+    uint32_t n_of_records = 0;
+    while (io_next_dirty_run(fs, true, &page, &offset, &length) == true) {
+        transaction_length += sizeof(JOURNAL_RECORD) + ALIGN_UP(length, STRUCT_ALIGNMENT);
+        n_of_records++;
+    }
+
+    if (transaction_length > (size_t) fs->superblock->journal_size) {
+        return JOURNAL_TOO_BIG;
+    }
+
+    // journal is full, start from the beginning again
+    if (fs->journal_head + transaction_length > (size_t) fs->superblock->journal_size) {
+        // the previous transaction must not be needed any more once it is overwritten
+        io_sync(fs);
+        fs->journal_head = 0;
+    }
+
+    char *buffer = calloc(1, transaction_length);
+    if (buffer == NULL) {
+        return JOURNAL_FAILED;
+    }
+
+    // records - position, length and the current content of every dirty run
+    char *position = buffer + sizeof(JOURNAL_TRANSACTION);
+    page = 0;
+    while (io_next_dirty_run(fs, true, &page, &offset, &length) == true) {
+        JOURNAL_RECORD *record = (JOURNAL_RECORD *) position;
+        record->offset = offset;
+        record->length = length;
+        memcpy(position + sizeof(JOURNAL_RECORD), io_ptr(fs, offset), length);
+        position += sizeof(JOURNAL_RECORD) + ALIGN_UP(length, STRUCT_ALIGNMENT);
+    }
+
+    JOURNAL_TRANSACTION *transaction = (JOURNAL_TRANSACTION *) buffer;
+    transaction->magic = JOURNAL_MAGIC;
+    transaction->n_of_records = n_of_records;
+    transaction->sequence = fs->journal_sequence;
+    transaction->length = transaction_length;
+    transaction->checksum = journal_checksum(buffer + sizeof(JOURNAL_TRANSACTION),
+                                             transaction_length - sizeof(JOURNAL_TRANSACTION));
+
+    // one sequential write and one fsync per command
+    bool result = io_pwrite(fs, buffer, fs->superblock->journal_start_address + fs->journal_head,
+                            transaction_length);
+    free(buffer);
+    if (result == false || io_sync(fs) == false) {
+        return JOURNAL_FAILED;
+    }
+
+    fs->journal_head += transaction_length;
+    fs->journal_sequence++;
+    return JOURNAL_COMMITTED;
+}
+
+/**
+ * Zneplatní obsah žurnálu - na jeho začátek zapíše prázdnou transakci s nejvyšším pořadovým číslem
+ * a zavolá fsync. Obnova po pádu pak nemá co přehrávat, starší transakce se už nepoužijí.
+ *
+ * @param fs - struktura file systému
+ *
+ * @return  true - žurnál je na disku prázdný
+ *          false - transakci nelze zapsat nebo synchronizovat
+ */
+bool journal_invalidate(FS *fs) {
+    JOURNAL_TRANSACTION transaction;
+    memset(&transaction, 0, sizeof(JOURNAL_TRANSACTION));
+    transaction.magic = JOURNAL_MAGIC;
+    transaction.sequence = fs->journal_sequence;
+    transaction.length = sizeof(JOURNAL_TRANSACTION);
+    transaction.checksum = journal_checksum((char *) &transaction + sizeof(JOURNAL_TRANSACTION), 0);
+
+    if (io_pwrite(fs, &transaction, fs->superblock->journal_start_address, sizeof(JOURNAL_TRANSACTION)) == false ||
+        io_sync(fs) == false) {
+        return false;
+    }
+
+    fs->journal_head = sizeof(JOURNAL_TRANSACTION);
+    fs->journal_sequence++;
+    return true;
+}
+
+/**
+ * Uzavře žurnál při řádném ukončení. Všechna metadata se synchronně zapíšou na místo a na začátek
+ * žurnálu se zapíše prázdná transakce, příští načtení tak nemá co přehrávat.
+ *
+ * @param fs - struktura file systému
+ */
+void journal_close(FS *fs) {
+    io_sync(fs);
+    journal_invalidate(fs);
+}
+
+/**
+ * Vynuluje celý žurnál. Volá se, když na začátku žurnálu není platná transakce, ale žurnál prázdný
+ * není - staré transakce za ním by jinak mohly mít vyšší pořadové číslo než nové.
+ *
+ * @param fs - struktura file systému
+ */
+static void journal_clear(FS *fs) {
+    char *zeros = calloc(1, JOURNAL_ALIGNMENT);
+    if (zeros == NULL) {
+        return;
+    }
+
+    for (int64_t offset = 0; offset < fs->superblock->journal_size; offset += JOURNAL_ALIGNMENT) {
+        io_pwrite(fs, zeros, fs->superblock->journal_start_address + offset, JOURNAL_ALIGNMENT);
+    }
+    io_sync(fs);
+    free(zeros);
+}
+
+/**
+ * Vrátí, zda na dané pozici žurnálu leží celá platná transakce.
+ *
+ * @param fs - struktura file systému
+ * @param position - pozice v žurnálu
+ *
+ * @return  transakce
+ *          NULL, pokud tam platná transakce není
+ */
+static JOURNAL_TRANSACTION *journal_transaction_at(FS *fs, int64_t position) {
+    int64_t size = fs->superblock->journal_size;
+    if (position + (int64_t) sizeof(JOURNAL_TRANSACTION) > size) {
+        return NULL;
+    }
+
+    JOURNAL_TRANSACTION *transaction = (JOURNAL_TRANSACTION *) io_ptr(fs, fs->superblock->journal_start_address +
+                                                                          position);
+    if (transaction->magic != JOURNAL_MAGIC || transaction->length < sizeof(JOURNAL_TRANSACTION) ||
+        transaction->length > (uint64_t) (size - position)) {
+        return NULL;
+    }
+
+    char *records = (char *) transaction + sizeof(JOURNAL_TRANSACTION);
+    if (journal_checksum(records, transaction->length - sizeof(JOURNAL_TRANSACTION)) != transaction->checksum) {
+        return NULL;
+    }
+
+    return transaction;
+}
+
+/**
+ * Po pádu obnoví metadata ze žurnálu. Transakce starší než poslední platná už jsou na svém místě
+ * (zapsal je fsync další transakce), přehrává se proto jen ta s nejvyšším pořadovým číslem.
+ * Volá se při načítání FS, ještě před čtením bitmap a i-nodů.
+ *
+ * @param fs - struktura file systému
+ *
+ * @return pořadové číslo přehrané transakce, 0 = nebylo co přehrát (žurnál byl řádně uzavřen)
+ */
+int32_t journal_replay(FS *fs) {
+    JOURNAL_TRANSACTION *last = NULL;
+    int64_t last_end = 0;
+
+    // transactions follow each other from the start of the journal
+    int64_t position = 0;
+    JOURNAL_TRANSACTION *transaction = journal_transaction_at(fs, position);
+    while (transaction != NULL) {
+        if (last == NULL || transaction->sequence > last->sequence) {
+            last = transaction;
+            last_end = position + transaction->length;
+        }
+        position += transaction->length;
+        transaction = journal_transaction_at(fs, position);
+    }
+
+    fs->journal_head = last_end;
+    fs->journal_sequence = (last == NULL) ? 1 : last->sequence + 1;
+
+    if (last == NULL) {
+        JOURNAL_TRANSACTION *first = (JOURNAL_TRANSACTION *) io_ptr(fs, fs->superblock->journal_start_address);
+        if (first->magic != 0 || first->length != 0) {
+            journal_clear(fs);
+        }
+        return 0;
+    }
+    if (last->n_of_records == 0) {
+        return 0;
+    }
+
+    // write the records to the mapping and to their place in the file
+    char *position_in_records = (char *) last + sizeof(JOURNAL_TRANSACTION);
+    for (uint32_t i = 0; i < last->n_of_records; i++) {
+        JOURNAL_RECORD *record = (JOURNAL_RECORD *) position_in_records;
+        char *data = position_in_records + sizeof(JOURNAL_RECORD);
+
+        if (record->offset + record->length <= fs->map_size) {
+            memcpy(io_ptr(fs, record->offset), data, record->length);
+            io_pwrite(fs, data, record->offset, record->length);
+        }
+        position_in_records += sizeof(JOURNAL_RECORD) + ALIGN_UP(record->length, STRUCT_ALIGNMENT);
+    }
+    io_sync(fs);
+
+    return (int32_t) last->sequence;
+}
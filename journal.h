@@ -0,0 +1,12 @@
+#ifndef ZOS_JOURNAL_H
+#define ZOS_JOURNAL_H
+
+#include "header.h"
+
+int64_t journal_size(int64_t disk_size);
+int32_t journal_commit(FS *fs);
+bool journal_invalidate(FS *fs);
+void journal_close(FS *fs);
+int32_t journal_replay(FS *fs);
+
+#endif //ZOS_JOURNAL_H
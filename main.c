@@ -2,155 +2,148 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "header.h"
 #include "fs.h"
 #include "inodes.h"
 #include "commands.h"
 #include "directory.h"
+#include "io.h"
+#include "stats.h"
+#include "trace.h"
+#include "arena.h"
 
-#define SIGNATURE "toti"
-#define DESCRIPTOR "inodes pseudo file system"
 #define FILENAME "myFS"
 
-int isRunning = 1;      // 1 = yes
+/**
+ * Runs the commands of the -c argument, separated by ';'. The image stays mapped for the whole
+ * run, every command is flushed on its own.
+ *
+ * @return EXIT_SUCCESS if all commands succeeded, EXIT_FAILURE otherwise
+ */
+int run_command_string(FS *fs, char *script) {
+    char command[MAX_COMMAND_LENGTH];
+    int status = EXIT_SUCCESS;
+
+    while (isRunning && script != NULL) {
+        // cut one command, the commands use strtok themselves
+        char *end = strchr(script, ';');
+        size_t length = (end == NULL) ? strlen(script) : (size_t) (end - script);
+        char *start = script;
+        script = (end == NULL) ? NULL : end + 1;
+
+        if (length >= MAX_COMMAND_LENGTH) {
+            printf("COMMAND TOO LONG\n");
+            status = EXIT_FAILURE;
+            continue;
+        }
+        memcpy(command, start, length);
+        command[length] = '\0';
+        trace_record(command);
 
-int main(int argc, char *argv[]) {
+        char *token = strtok(command, SPLIT_ARGS_CHAR);
+        if (token == NULL) {
+            continue;
+        }
+        if (commands(fs, token) == false) {
+            status = EXIT_FAILURE;
+        }
 
-    // handle argument - FS filename
-    char name[FS_FILENAME_LENGTH];
-    if(argc > 1) {
-        strcpy(name, argv[1]);
+        // command boundary - flush the mapped image
+        io_flush(fs);
     }
-    else {
-        strcpy(name, FILENAME);
+
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    char name[FS_FILENAME_LENGTH];
+    char *script = NULL;
+    char *stats_file = NULL;
+    char *trace_file = NULL;
+    int status = EXIT_SUCCESS;
+
+    // handle arguments - FS filename, -c "cmd; cmd", -s stats.json and -t trace.txt
+    strcpy(name, FILENAME);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            script = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            stats_file = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (argv[i][0] == '-' || strlen(argv[i]) >= FS_FILENAME_LENGTH) {
+            fprintf(stderr, "Usage: %s [image] [-c \"command; command\"] [-s stats.json] [-t trace.txt]\n", argv[0]);
+            return 2;
+        } else {
+            strcpy(name, argv[i]);
+        }
     }
 
+    // scripts and pipes get no prompt
+    isInteractive = script == NULL && isatty(STDIN_FILENO);
+
     // initialize FS
     FS *fs = NULL;
-    fs = fs_init(name, SIGNATURE, DESCRIPTOR, DISK_SIZE, 1);
+    fs = fs_init(name, SIGNATURE, DESCRIPTOR, DISK_SIZE, CLUSTER_SIZE, 0, 1);
+    if (fs == NULL) {
+        return EXIT_FAILURE;
+    }
+    if (isInteractive) {
+        print_fs(fs);
+    }
+
+    // the commands of the session are recorded for zos_replay
+    if (trace_file != NULL && trace_open(trace_file) == false) {
+        fprintf(stderr, "Cannot write trace to %s\n", trace_file);
+    }
 
     // command from user
     char command[MAX_COMMAND_LENGTH];
     char *token;
 
-    while (isRunning) {
-        if (fs->actual_path[0] == 0) {
-            printf("%s:%s%s%s", fs->superblock->signature, ROOT_CHAR, fs->actual_path, SHELL_CHAR);
-        } else {
-            printf("%s:%s%s", fs->superblock->signature, fs->actual_path, SHELL_CHAR);
+    if (script != NULL) {
+        status = run_command_string(fs, script);
+    }
+
+    while (isRunning && script == NULL) {
+        if (isInteractive) {
+            if (fs->actual_path[0] == 0) {
+                printf("%s:%s%s%s", fs->superblock->signature, ROOT_CHAR, fs->actual_path, SHELL_CHAR);
+            } else {
+                printf("%s:%s%s", fs->superblock->signature, fs->actual_path, SHELL_CHAR);
+            }
         }
 
-        // gets command from user
-        fgets(command, MAX_COMMAND_LENGTH, stdin);
+        // gets command from user, end of input ends the session
+        if (fgets(command, MAX_COMMAND_LENGTH, stdin) == NULL) {
+            break;
+        }
+        trace_record(command);
 
         // splits the arguments
         token = strtok(command, SPLIT_ARGS_CHAR);
-
-        fs->FILE = fopen(fs->filename, "rb+");
+        if (token == NULL) {
+            continue;
+        }
 
         // sends command to the functions that handles it
-        commands(fs, token);
+        if (commands(fs, token) == false && isInteractive == 0) {
+            status = EXIT_FAILURE;
+        }
 
-        fclose(fs->FILE);
+        // command boundary - flush the mapped image
+        io_flush(fs);
     }
 
+    io_close(fs);
     free(fs);
-    return 0;
-}
+    trace_close();
+    arena_free();
 
-/**
- * Handles commands from user.
- *
- */
-void commands(FS *fs, char *token) {
-    // incp - nahraje soubor s1 z pevného disku do umístění s2 v pseudoNTFS
-    if (strcmp(token, FILE_IN) == 0) {
-        file_in(fs, token);
-        update_current_directory(fs);
-    }
-    // ls - print directory
-    else if (are_strings_equal(token, PRINT_DIRECTORY) == true) {
-        print_directory(fs, token);
-    }
-    // cat - print file
-    else if (strcmp(token, PRINT_FILE) == 0) {
-        print_file(fs, token);
-    }
-    // mkdir - create directory
-    else if (strcmp(token, MAKE_DIRECTORY) == 0) {
-        make_directory(fs, token);
-        update_current_directory(fs);
-    }
-    // rm - remove file
-    else if (strcmp(token, REMOVE_FILE) == 0) {
-        remove_file_or_directory(fs, token, false);
-        update_current_directory(fs);
-    }
-    // rmdir - remove directory
-    else if (strcmp(token, REMOVE_EMPTY_DIRECTORY) == 0) {
-        remove_file_or_directory(fs, token, true);
-        update_current_directory(fs);
-    }
-    // cp - copy file
-    else if (strcmp(token, COPY_FILE) == 0) {
-        copy_file(fs, token);
-        update_current_directory(fs);
-    }
-    // mv - move file
-    else if (strcmp(token, MOVE_FILE) == 0) {
-        move_file(fs, token);
-        update_current_directory(fs);
-    }
-    // cd - change directory
-    else if (strcmp(token, CHANGE_DIRECTORY) == 0) {
-        change_directory(fs, token);
+    // statistics of the whole session, written on quit
+    if (stats_file != NULL && write_stats_json(stats_file) == false) {
+        fprintf(stderr, "Cannot write statistics to %s\n", stats_file);
     }
-    // pwd - print working directory
-    else if (are_strings_equal(token, PRINT_WORKING_DIRECTORY) == true) {
-        print_working_directory(fs);
-    }
-    // info - print info about file or directory
-    else if (strcmp(token, INFO) == 0) {
-        print_info(fs, token);
-    }
-    // outcp - nahraje soubor s1 z pseudoNTFS do umístění s2 na pevném disku
-    else if (strcmp(token, FILE_OUT) == 0) {
-        file_out(fs, token);
-        update_current_directory(fs);
-    }
-    // load
-    else if (strcmp(token, LOAD_COMMANDS) == 0) {
-        printf("load\n");
-        load_file_with_commands(fs, token);
-        update_current_directory(fs);
-    }
-    // format
-    else if (strcmp(token, FORMAT) == 0) {
-        FS *new_fs = format_fs(token, FILENAME, SIGNATURE, DESCRIPTOR);
-        if (new_fs != NULL) {
-            fs = new_fs;
-        }
-        update_current_directory(fs);
-    }
-    // slink - creates symbolic link
-    else if(strcmp(token, S_LINK) == 0) {
-        create_slink(fs, token);
-        update_current_directory(fs);
-    }
-    // quit
-    else if(are_strings_equal(token, QUIT) == true) {
-        isRunning = 0;
-    }
-    // print FS
-    else if(are_strings_equal(token, PRINT_FS) == true) {
-        print_fs(fs);
-    }
-    // print help
-    else if(are_strings_equal(token, HELP) == true) {
-        print_help(fs);
-    }
-    else {
-        printf("Command not found.");
-    }
-
+    return status;
 }
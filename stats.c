@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/resource.h>
+#include "header.h"
+#include "stats.h"
+
+// counters of the whole run, the I/O layer increments stats.io directly
+STATS stats;
+
+/**
+ * Vrátí monotónní čas v nanosekundách.
+ *
+ * @return čas v ns
+ */
+int64_t stats_now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t) time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/**
+ * Uloží aktuální hodnoty I/O čítačů, včetně stránek mapování načtených z disku.
+ *
+ * @param counters - výstup, hodnoty čítačů
+ */
+void stats_snapshot(IO_COUNTERS *counters) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats.io.page_faults = usage.ru_majflt;
+    }
+    *counters = stats.io;
+}
+
+/**
+ * Upraví příkaz na jméno pro statistiky - jen první slovo bez konce řádku, znaky, které by
+ * rozbily JSON, se nahradí '_'. Zaznamenávají se i neznámé příkazy.
+ *
+ * @param command - příkaz
+ * @param name - výstup, jméno příkazu
+ */
+void stats_command_name(const char *command, char name[STATS_NAME_LENGTH]) {
+    snprintf(name, STATS_NAME_LENGTH, "%s", command);
+    name[strcspn(name, "\r\n")] = '\0';
+
+    for (char *c = name; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\' || (unsigned char) *c < ' ') {
+            *c = '_';
+        }
+    }
+}
+
+/**
+ * Najde v poli položku příkazu, případně pro něj založí novou. Když jsou všechny položky
+ * obsazené, patří příkaz do poslední (ostatní). Položka musí začínat jménem příkazu
+ * (char[STATS_NAME_LENGTH]), pole má STATS_MAX_COMMANDS položek.
+ *
+ * @param entries - pole položek
+ * @param entry_size - velikost jedné položky
+ * @param n_of_entries - počet použitých položek
+ * @param command - jméno příkazu ze stats_command_name
+ *
+ * @return položka příkazu
+ */
+void *stats_find_entry(void *entries, size_t entry_size, int32_t *n_of_entries, const char *command) {
+    char *entry = entries;
+    for (int32_t i = 0; i < *n_of_entries; i++, entry += entry_size) {
+        if (strncmp(entry, command, STATS_NAME_LENGTH - 1) == 0) {
+            return entry;
+        }
+    }
+
+    if (*n_of_entries == STATS_MAX_COMMANDS - 1) {
+        char *other = (char *) entries + (STATS_MAX_COMMANDS - 1) * entry_size;
+        strcpy(other, "other");
+        return other;
+    }
+
+    (*n_of_entries)++;
+    snprintf(entry, STATS_NAME_LENGTH, "%s", command);
+    return entry;
+}
+
+/**
+ * Přičte k položce rozdíl I/O čítačů.
+ *
+ * @param total - součty příkazu
+ * @param before - čítače před příkazem
+ * @param after - čítače po příkazu
+ */
+static void stats_add(IO_COUNTERS *total, IO_COUNTERS *before, IO_COUNTERS *after) {
+    total->bytes_read += after->bytes_read - before->bytes_read;
+    total->bytes_written += after->bytes_written - before->bytes_written;
+    total->writes += after->writes - before->writes;
+    total->seeks += after->seeks - before->seeks;
+    total->syncs += after->syncs - before->syncs;
+    total->page_faults += after->page_faults - before->page_faults;
+    total->clusters_allocated += after->clusters_allocated - before->clusters_allocated;
+    total->clusters_freed += after->clusters_freed - before->clusters_freed;
+    total->inodes_allocated += after->inodes_allocated - before->inodes_allocated;
+}
+
+/**
+ * Připíše poslednímu příkazu I/O od jeho konce - zápis jeho změn (io_flush) přichází až po něm.
+ *
+ * @param now - aktuální čítače
+ */
+static void stats_settle(IO_COUNTERS *now) {
+    if (stats.last != NULL) {
+        stats_add(&stats.last->io, &stats.last_end, now);
+        stats.last_end = *now;
+    }
+}
+
+/**
+ * Začne měření příkazu.
+ *
+ * @param before - výstup, I/O čítače na začátku příkazu
+ */
+void stats_begin(IO_COUNTERS *before) {
+    stats_snapshot(before);
+    stats_settle(before);
+    stats.last = NULL;
+}
+
+/**
+ * Zaznamená jedno volání příkazu - čas do histogramu a I/O od začátku příkazu. Vnořené příkazy
+ * (load) se počítají i do příkazu, který je spustil.
+ *
+ * @param command - jméno příkazu
+ * @param result - výsledek příkazu
+ * @param elapsed_ns - doba příkazu v ns
+ * @param before - I/O čítače ze začátku příkazu
+ */
+void stats_record(const char *command, bool result, int64_t elapsed_ns, IO_COUNTERS *before) {
+    char name[STATS_NAME_LENGTH];
+    stats_command_name(command, name);
+
+    COMMAND_STATS *entry = stats_find_entry(stats.commands, sizeof(COMMAND_STATS), &stats.n_of_commands, name);
+    IO_COUNTERS after;
+    stats_snapshot(&after);
+
+    entry->calls++;
+    if (result == false) {
+        entry->failures++;
+    }
+    entry->total_ns += elapsed_ns;
+    if ((uint64_t) elapsed_ns > entry->max_ns) {
+        entry->max_ns = elapsed_ns;
+    }
+
+    int32_t bucket = 0;
+    for (int64_t us = elapsed_ns / 1000; us > 0 && bucket < STATS_BUCKETS - 1; us >>= 1) {
+        bucket++;
+    }
+    entry->histogram[bucket]++;
+
+    stats_add(&entry->io, before, &after);
+    stats.last = entry;
+    stats.last_end = after;
+}
+
+/**
+ * Vynuluje statistiky příkazů. I/O čítače běží dál, příkazy počítají jen jejich rozdíly.
+ */
+void stats_reset(void) {
+    memset(stats.commands, 0, sizeof(stats.commands));
+    stats.n_of_commands = 0;
+    stats.last = NULL;
+}
+
+/**
+ * Vypíše statistiky příkazů a I/O na obrazovku.
+ */
+void print_stats(void) {
+    IO_COUNTERS io;
+    stats_snapshot(&io);
+    stats_settle(&io);
+
+    printf("--- STATS ---\n");
+    printf("%-10s %8s %6s %12s %12s %12s %12s %8s %8s %8s %8s %8s\n", "COMMAND", "CALLS", "FAILED", "TOTAL_MS",
+           "MAX_MS", "READ_B", "WRITTEN_B", "WRITES", "SEEKS", "SYNCS", "FAULTS", "CLUSTERS");
+    for (int32_t i = 0; i < STATS_MAX_COMMANDS; i++) {
+        COMMAND_STATS *entry = &stats.commands[i];
+        if (entry->calls == 0) {
+            continue;
+        }
+        printf("%-10s %8" PRIu64 " %6" PRIu64 " %12.3f %12.3f %12" PRIu64 " %12" PRIu64 " %8" PRIu64 " %8" PRIu64
+               " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 "\n", entry->name, entry->calls, entry->failures,
+               entry->total_ns / 1e6, entry->max_ns / 1e6, entry->io.bytes_read, entry->io.bytes_written,
+               entry->io.writes, entry->io.seeks, entry->io.syncs, entry->io.page_faults,
+               entry->io.clusters_allocated);
+
+        // only the buckets that were hit
+        printf("           latency:");
+        for (int32_t bucket = 0; bucket < STATS_BUCKETS; bucket++) {
+            if (entry->histogram[bucket] > 0) {
+                printf(" <%" PRIu64 "us:%" PRIu64, UINT64_C(1) << bucket, entry->histogram[bucket]);
+            }
+        }
+        printf("\n");
+    }
+
+    printf("Total: read %" PRIu64 "B, written %" PRIu64 "B, %" PRIu64 " writes, %" PRIu64 " seeks, %" PRIu64
+           " syncs, %" PRIu64 " page faults\n", io.bytes_read, io.bytes_written, io.writes, io.seeks, io.syncs,
+           io.page_faults);
+    printf("Allocated %" PRIu64 " clusters, freed %" PRIu64 " clusters, allocated %" PRIu64 " i-nodes\n\n",
+           io.clusters_allocated, io.clusters_freed, io.inodes_allocated);
+}
+
+/**
+ * Zapíše řetězec jako JSON řetězec včetně uvozovek.
+ *
+ * @param file - výstupní soubor
+ * @param string - řetězec
+ */
+void print_json_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for (const char *c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char) *c < ' ') {
+            fprintf(file, "\\u%04x", (unsigned char) *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * Zapíše I/O čítače jako JSON objekt.
+ *
+ * @param file - výstupní soubor
+ * @param io - čítače
+ */
+static void print_io_json(FILE *file, IO_COUNTERS *io) {
+    fprintf(file, "{\"bytes_read\": %" PRIu64 ", \"bytes_written\": %" PRIu64 ", \"writes\": %" PRIu64
+                  ", \"seeks\": %" PRIu64 ", \"syncs\": %" PRIu64 ", \"page_faults\": %" PRIu64
+                  ", \"clusters_allocated\": %" PRIu64 ", \"clusters_freed\": %" PRIu64
+                  ", \"inodes_allocated\": %" PRIu64 "}", io->bytes_read, io->bytes_written, io->writes, io->seeks,
+            io->syncs, io->page_faults, io->clusters_allocated, io->clusters_freed, io->inodes_allocated);
+}
+
+/**
+ * Zapíše statistiky příkazů a I/O jako JSON.
+ *
+ * @param file - výstupní soubor
+ */
+void print_stats_json(FILE *file) {
+    IO_COUNTERS io;
+    stats_snapshot(&io);
+    stats_settle(&io);
+
+    fprintf(file, "{\n  \"io\": ");
+    print_io_json(file, &io);
+    fprintf(file, ",\n  \"histogram_bucket_us\": [");
+    for (int32_t bucket = 0; bucket < STATS_BUCKETS; bucket++) {
+        fprintf(file, "%s%" PRIu64, bucket == 0 ? "" : ", ", UINT64_C(1) << bucket);
+    }
+    fprintf(file, "],\n  \"commands\": [");
+
+    bool first = true;
+    for (int32_t i = 0; i < STATS_MAX_COMMANDS; i++) {
+        COMMAND_STATS *entry = &stats.commands[i];
+        if (entry->calls == 0) {
+            continue;
+        }
+        fprintf(file, "%s\n    {\"command\": \"%s\", \"calls\": %" PRIu64 ", \"failures\": %" PRIu64
+                      ", \"total_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 ", \"histogram\": [",
+                first ? "" : ",", entry->name, entry->calls, entry->failures, entry->total_ns, entry->max_ns);
+        for (int32_t bucket = 0; bucket < STATS_BUCKETS; bucket++) {
+            fprintf(file, "%s%" PRIu64, bucket == 0 ? "" : ", ", entry->histogram[bucket]);
+        }
+        fprintf(file, "], \"io\": ");
+        print_io_json(file, &entry->io);
+        fprintf(file, "}");
+        first = false;
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+
+/**
+ * Zapíše statistiky jako JSON do souboru.
+ *
+ * @param filename - jméno souboru
+ *
+ * @return  true - statistiky jsou zapsané
+ *          false - soubor nelze zapsat
+ */
+bool write_stats_json(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    print_stats_json(file);
+    return fclose(file) == 0;
+}
@@ -0,0 +1,21 @@
+#ifndef ZOS_STATS_H
+#define ZOS_STATS_H
+
+#include "header.h"
+
+extern STATS stats;
+
+int64_t stats_now(void);
+void stats_snapshot(IO_COUNTERS *counters);
+void stats_begin(IO_COUNTERS *before);
+void stats_record(const char *command, bool result, int64_t elapsed_ns, IO_COUNTERS *before);
+void stats_reset(void);
+void stats_command_name(const char *command, char name[STATS_NAME_LENGTH]);
+void *stats_find_entry(void *entries, size_t entry_size, int32_t *n_of_entries, const char *command);
+
+void print_stats(void);
+void print_stats_json(FILE *file);
+void print_json_string(FILE *file, const char *string);
+bool write_stats_json(const char *filename);
+
+#endif //ZOS_STATS_H
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "header.h"
+#include "trace.h"
+#include "stats.h"
+
+// the recorded session, NULL = nothing is recorded
+static FILE *trace_file = NULL;
+static int64_t trace_start = 0;
+
+/**
+ * Začne nahrávat příkazy do souboru. Každý řádek záznamu je čas od začátku nahrávání
+ * v mikrosekundách a příkaz tak, jak ho přečetl shell (nebo load).
+ *
+ * @param filename - soubor záznamu, existující obsah se přepíše
+ *
+ * @return  true - záznam je otevřený
+ *          false - soubor nelze vytvořit
+ */
+bool trace_open(const char *filename) {
+    trace_close();
+
+    trace_file = fopen(filename, "w");
+    if (trace_file == NULL) {
+        return false;
+    }
+
+    trace_start = stats_now();
+    fprintf(trace_file, "%s\n", TRACE_HEADER);
+    fflush(trace_file);
+    return true;
+}
+
+/**
+ * Zapíše příkaz do záznamu, pokud se nahrává. Příkaz load se nezapisuje, zapíšou se až příkazy
+ * z jeho souboru, přehrání tak nepotřebuje původní soubor s příkazy.
+ *
+ * @param command - řádek s příkazem
+ */
+void trace_record(const char *command) {
+    if (trace_file == NULL) {
+        return;
+    }
+
+    // empty lines and the load command itself
+    size_t start = strspn(command, SPLIT_ARGS_CHAR);
+    size_t length = strcspn(command + start, "\r\n");
+    size_t name_length = strcspn(command + start, SPLIT_ARGS_CHAR "\r\n");
+    if (length == 0 || (name_length == strlen(LOAD_COMMANDS) &&
+                        strncmp(command + start, LOAD_COMMANDS, name_length) == 0)) {
+        return;
+    }
+
+    fprintf(trace_file, "%" PRId64 " %.*s\n", (stats_now() - trace_start) / 1000, (int) length, command + start);
+
+    // the trace survives a crash of the session
+    fflush(trace_file);
+}
+
+/**
+ * Ukončí nahrávání a zavře soubor záznamu.
+ */
+void trace_close(void) {
+    if (trace_file != NULL) {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+}
+
+/**
+ * Rozdělí řádek záznamu na čas a příkaz. Konec řádku zůstává součástí příkazu, stejně jako
+ * u příkazů přečtených shellem.
+ *
+ * @param line - řádek záznamu
+ * @param time_us - výstup, čas příkazu od začátku nahrávání v mikrosekundách
+ * @param command - výstup, příkaz
+ *
+ * @return  true - řádek obsahuje příkaz
+ *          false - řádek je komentář, prázdný nebo neplatný
+ */
+bool trace_parse_line(char *line, int64_t *time_us, char **command) {
+    if (line[0] == '#') {
+        return false;
+    }
+
+    char *end = NULL;
+    *time_us = strtoll(line, &end, 10);
+    if (end == line || *end != ' ' || *time_us < 0) {
+        return false;
+    }
+
+    *command = end + 1;
+    return strcspn(*command, "\r\n") > 0;
+}
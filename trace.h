@@ -0,0 +1,11 @@
+#ifndef ZOS_TRACE_H
+#define ZOS_TRACE_H
+
+#include "header.h"
+
+bool trace_open(const char *filename);
+void trace_record(const char *command);
+void trace_close(void);
+bool trace_parse_line(char *line, int64_t *time_us, char **command);
+
+#endif //ZOS_TRACE_H
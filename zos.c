@@ -0,0 +1,501 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "header.h"
+#include "zos.h"
+#include "fs.h"
+#include "inodes.h"
+#include "directory.h"
+#include "io.h"
+#include "cache.h"
+
+/**
+ * Najde i-node na dané cestě. Na rozdíl od get_inode nic nevypisuje, nemění předanou cestu
+ * a nepoužívá strtok, takže nenaruší rozdělování argumentů volajícího.
+ *
+ * @param fs - struktura file systému
+ * @param path - absolutní cesta nebo cesta relativní k aktuálnímu adresáři
+ *
+ * @return  nalezený i-node
+ *          NULL, pokud cesta neexistuje
+ */
+static PSEUDO_INODE *zos_resolve(FS *fs, const char *path) {
+    char tmp_path[PATH_MAX];
+    char *save = NULL;
+
+    if (path == NULL || path[0] == '\0' || strlen(path) >= PATH_MAX) {
+        return NULL;
+    }
+    strcpy(tmp_path, path);
+
+    // every directory contains '.' and '..', so they are resolved like any other name
+    PSEUDO_INODE *inode = is_absolute_path(tmp_path) ? &fs->inodes->data[0] : fs->current_inode;
+    char *name = strtok_r(tmp_path, "/", &save);
+    while (name != NULL) {
+        if (inode->isDirectory == false) {
+            return NULL;
+        }
+
+        inode = cache_lookup(fs, inode, name);
+        if (inode == NULL) {
+            return NULL;
+        }
+        name = strtok_r(NULL, "/", &save);
+    }
+
+    return inode;
+}
+
+/**
+ * Najde rodičovský adresář poslední položky cesty a zkopíruje její jméno.
+ *
+ * @param fs - struktura file systému
+ * @param path - cesta k položce
+ * @param name - buffer pro jméno položky (MAX_FILENAME_LENGTH)
+ *
+ * @return  rodičovský adresář
+ *          NULL, pokud neexistuje nebo jméno není platné
+ */
+static PSEUDO_INODE *zos_resolve_parent(FS *fs, const char *path, char name[MAX_FILENAME_LENGTH]) {
+    char tmp_path[PATH_MAX];
+
+    if (path == NULL || strlen(path) >= PATH_MAX) {
+        return NULL;
+    }
+    strcpy(tmp_path, path);
+
+    // trailing slashes are not part of the name
+    size_t length = strlen(tmp_path);
+    while (length > 0 && tmp_path[length - 1] == '/') {
+        tmp_path[--length] = '\0';
+    }
+    if (length == 0) {
+        return NULL;
+    }
+
+    char *slash = strrchr(tmp_path, '/');
+    char *last = (slash == NULL) ? tmp_path : slash + 1;
+    if (strlen(last) >= MAX_FILENAME_LENGTH || strcmp(last, ".") == 0 || strcmp(last, "..") == 0) {
+        return NULL;
+    }
+    strcpy(name, last);
+
+    // the parent is the current directory, the root, or the path before the last slash
+    PSEUDO_INODE *parent = NULL;
+    if (slash == NULL) {
+        parent = fs->current_inode;
+    } else if (slash == tmp_path) {
+        parent = &fs->inodes->data[0];
+    } else {
+        *slash = '\0';
+        parent = zos_resolve(fs, tmp_path);
+    }
+
+    if (parent == NULL || parent->isDirectory == false) {
+        return NULL;
+    }
+
+    return parent;
+}
+
+/**
+ * Vrátí i-node s daným id, pokud je obsazený.
+ *
+ * @param fs - struktura file systému
+ * @param node_id - id i-nodu
+ *
+ * @return  i-node
+ *          NULL, pokud id neexistuje nebo je i-node volný
+ */
+static PSEUDO_INODE *zos_inode(FS *fs, int32_t node_id) {
+    if (node_id < 0 || node_id >= fs->inodes->size || fs->inodes->data[node_id].is_free == true) {
+        return NULL;
+    }
+
+    return &fs->inodes->data[node_id];
+}
+
+/**
+ * Po změně zapíše metadata, pokud by se jinak nevešla do žurnálu. Jinak se zapíšou až
+ * při zos_sync nebo zos_close, více změn tak tvoří jednu transakci.
+ *
+ * @param fs - struktura file systému
+ */
+static void zos_commit_if_full(FS *fs) {
+    if (io_should_flush(fs) == true) {
+        io_flush(fs);
+    }
+}
+
+/**
+ * Otevře obraz FS. Pokud soubor neexistuje, vytvoří nový FS s výchozí velikostí.
+ *
+ * @param image - cesta k souboru FS
+ *
+ * @return  struktura file systému
+ *          NULL, pokud FS nelze otevřít
+ */
+FS *zos_open(const char *image) {
+    char name[FS_FILENAME_LENGTH];
+
+    if (image == NULL || strlen(image) >= FS_FILENAME_LENGTH) {
+        return NULL;
+    }
+    strcpy(name, image);
+
+    return fs_init(name, SIGNATURE, DESCRIPTOR, DISK_SIZE, CLUSTER_SIZE, 0, 1);
+}
+
+/**
+ * Vytvoří nový prázdný FS v souboru, existující obsah souboru se zahodí.
+ *
+ * @param image - cesta k souboru FS
+ * @param disk_size - velikost disku
+ * @param cluster_size - velikost clusteru, mocnina dvou z CLUSTER_SIZE_MIN..CLUSTER_SIZE_MAX, 0 = CLUSTER_SIZE
+ * @param inode_count - počet i-nodů, 0 = podle velikosti disku
+ *
+ * @return  struktura file systému
+ *          NULL, pokud FS nelze vytvořit
+ */
+FS *zos_format(const char *image, int64_t disk_size, int32_t cluster_size, int32_t inode_count) {
+    char name[FS_FILENAME_LENGTH];
+
+    if (cluster_size == 0) {
+        cluster_size = CLUSTER_SIZE;
+    }
+    if (image == NULL || strlen(image) >= FS_FILENAME_LENGTH || disk_size <= 0 || inode_count < 0 ||
+        is_cluster_size_valid(cluster_size) == false) {
+        return NULL;
+    }
+    strcpy(name, image);
+
+    return fs_init(name, SIGNATURE, DESCRIPTOR, disk_size, cluster_size, inode_count, 0);
+}
+
+/**
+ * Zapíše všechny dosavadní změny do souboru FS jako jednu transakci žurnálu.
+ *
+ * @param fs - struktura file systému
+ */
+void zos_sync(FS *fs) {
+    io_flush(fs);
+}
+
+/**
+ * Zapíše změny, uzavře obraz FS a uvolní strukturu file systému.
+ *
+ * @param fs - struktura file systému
+ */
+void zos_close(FS *fs) {
+    if (fs == NULL) {
+        return;
+    }
+
+    io_close(fs);
+    cache_free(fs->cache);
+    free(fs->actual_path);
+    free(fs->filename);
+    free(fs);
+}
+
+/**
+ * Vrátí id i-nodu na dané cestě.
+ *
+ * @param fs - struktura file systému
+ * @param path - cesta k položce
+ *
+ * @return id i-nodu, -1 = cesta neexistuje
+ */
+int32_t zos_lookup(FS *fs, const char *path) {
+    PSEUDO_INODE *inode = zos_resolve(fs, path);
+
+    return (inode == NULL) ? -1 : inode->node_id;
+}
+
+/**
+ * Vyplní informace o i-nodu.
+ *
+ * @param fs - struktura file systému
+ * @param node_id - id i-nodu
+ * @param stat - struktura pro výsledek
+ *
+ * @return  true - i-node existuje
+ *          false - jinak
+ */
+bool zos_stat(FS *fs, int32_t node_id, ZOS_STAT *stat) {
+    PSEUDO_INODE *inode = zos_inode(fs, node_id);
+    if (inode == NULL || stat == NULL) {
+        return false;
+    }
+
+    stat->node_id = inode->node_id;
+    stat->parent_id = inode->parent_id;
+    stat->is_directory = inode->isDirectory;
+    stat->is_slink = inode->isSLink;
+    stat->linked_node_id = inode->isSLink ? inode->linked_node_id : -1;
+    stat->count_clusters = inode->count_clusters;
+    stat->size = inode->file_size;
+
+    return true;
+}
+
+/**
+ * Přečte část souboru. Symbolický odkaz se čte jako soubor, na který odkazuje.
+ *
+ * @param fs - struktura file systému
+ * @param node_id - id i-nodu souboru
+ * @param buffer - buffer pro data
+ * @param offset - pozice v souboru
+ * @param length - maximální počet bajtů
+ *
+ * @return počet přečtených bajtů (0 = konec souboru), -1 = chyba
+ */
+int64_t zos_read(FS *fs, int32_t node_id, void *buffer, int64_t offset, int64_t length) {
+    PSEUDO_INODE *inode = zos_inode(fs, node_id);
+    if (inode != NULL && inode->isSLink == true) {
+        inode = zos_inode(fs, inode->linked_node_id);
+    }
+    if (inode == NULL || inode->isDirectory == true || offset < 0 || length < 0) {
+        return -1;
+    }
+
+    return inode_read(fs, inode, buffer, offset, length);
+}
+
+/**
+ * Zapíše data na danou pozici existujícího souboru. Přepisuje se na místě, soubor se prodlouží
+ * jen o clustery, které zápis potřebuje. Clustery sdílené s kopií souboru se před zápisem zkopírují.
+ *
+ * @param fs - struktura file systému
+ * @param node_id - id i-nodu souboru
+ * @param buffer - data
+ * @param offset - pozice v souboru, za koncem souboru se mezera vyplní nulami
+ * @param length - počet bajtů
+ *
+ * @return počet zapsaných bajtů, -1 = chyba
+ */
+int64_t zos_pwrite(FS *fs, int32_t node_id, const void *buffer, int64_t offset, int64_t length) {
+    PSEUDO_INODE *inode = zos_inode(fs, node_id);
+    if (inode != NULL && inode->isSLink == true) {
+        inode = zos_inode(fs, inode->linked_node_id);
+    }
+    if (inode == NULL || inode->isDirectory == true || offset < 0 || length < 0 ||
+        (buffer == NULL && length > 0)) {
+        return -1;
+    }
+
+    int64_t written = inode_write(fs, inode, buffer, offset, length);
+    zos_commit_if_full(fs);
+
+    return written;
+}
+
+/**
+ * Vytvoří nový soubor s daným obsahem.
+ *
+ * @param fs - struktura file systému
+ * @param path - cesta k novému souboru
+ * @param buffer - obsah souboru
+ * @param length - délka obsahu
+ *
+ * @return  true - soubor byl vytvořen
+ *          false - jinak
+ */
+bool zos_write(FS *fs, const char *path, const void *buffer, int64_t length) {
+    char name[MAX_FILENAME_LENGTH];
+    char empty[1];
+
+    PSEUDO_INODE *parent = zos_resolve_parent(fs, path, name);
+    if (parent == NULL || length < 0 || (buffer == NULL && length > 0)) {
+        return false;
+    }
+
+    // the buffer is streamed into the clusters like a host file, an empty stream can't be opened read-only
+    FILE *source = (length > 0) ? fmemopen((void *) buffer, (size_t) length, "rb") : fmemopen(empty, 1, "w+");
+    if (source == NULL) {
+        return false;
+    }
+
+    // closes the stream
+    bool result = create_file_in_FS(fs, source, name, parent);
+    zos_commit_if_full(fs);
+
+    return result;
+}
+
+/**
+ * Připojí data na konec existujícího souboru. Doplní se poslední neúplný cluster, nové clustery
+ * se alokují jen pro zbytek dat.
+ *
+ * @param fs - struktura file systému
+ * @param node_id - id i-nodu souboru
+ * @param buffer - data
+ * @param length - počet bajtů
+ *
+ * @return počet připojených bajtů, -1 = chyba
+ */
+int64_t zos_append(FS *fs, int32_t node_id, const void *buffer, int64_t length) {
+    PSEUDO_INODE *inode = zos_inode(fs, node_id);
+    if (inode != NULL && inode->isSLink == true) {
+        inode = zos_inode(fs, inode->linked_node_id);
+    }
+    if (inode == NULL || inode->isDirectory == true) {
+        return -1;
+    }
+
+    return zos_pwrite(fs, inode->node_id, buffer, inode->file_size, length);
+}
+
+/**
+ * Vytvoří adresář.
+ *
+ * @param fs - struktura file systému
+ * @param path - cesta k novému adresáři
+ *
+ * @return  true - adresář byl vytvořen
+ *          false - jinak
+ */
+bool zos_mkdir(FS *fs, const char *path) {
+    char name[MAX_FILENAME_LENGTH];
+
+    PSEUDO_INODE *parent = zos_resolve_parent(fs, path, name);
+    if (parent == NULL || directory_lookup(fs, parent, name) != -1) {
+        return false;
+    }
+
+    PSEUDO_INODE *new_inode = get_free_inode(fs);
+    if (new_inode == NULL || add_item_to_directory(fs, parent, name, new_inode) == false) {
+        return false;
+    }
+
+    // the directory needs one cluster, without it the item is taken back
+    DIRECTORY_ITEMS *new_dir = create_directory_item(fs, parent->node_id, new_inode, name);
+    if (new_dir == NULL) {
+        directory_remove(fs, parent, name);
+        return false;
+    }
+    write_directory_items_to_file(fs, new_dir, new_inode);
+    free_directory_items(new_dir);
+    zos_commit_if_full(fs);
+
+    return true;
+}
+
+/**
+ * Odstraní soubor, symbolický odkaz nebo prázdný adresář.
+ *
+ * @param fs - struktura file systému
+ * @param path - cesta k položce
+ *
+ * @return  true - položka byla odstraněna
+ *          false - jinak
+ */
+bool zos_unlink(FS *fs, const char *path) {
+    char name[MAX_FILENAME_LENGTH];
+
+    PSEUDO_INODE *parent = zos_resolve_parent(fs, path, name);
+    if (parent == NULL) {
+        return false;
+    }
+
+    PSEUDO_INODE *inode = cache_lookup(fs, parent, name);
+    if (inode == NULL || inode->node_id == 0 || inode == fs->current_inode) {
+        return false;
+    }
+
+    // only '.' and '..' may be left in a directory
+    if (inode->isDirectory == true && cache_get_directory(fs, inode)->size > 2) {
+        return false;
+    }
+
+    if (delete_inode(fs, inode, name) == false) {
+        return false;
+    }
+    release_inode(fs, inode);
+    zos_commit_if_full(fs);
+
+    return true;
+}
+
+/**
+ * Přejmenuje nebo přesune soubor či adresář. Cílové jméno nesmí existovat.
+ *
+ * @param fs - struktura file systému
+ * @param old_path - cesta k položce
+ * @param new_path - nová cesta k položce
+ *
+ * @return  true - položka byla přesunuta
+ *          false - jinak
+ */
+bool zos_rename(FS *fs, const char *old_path, const char *new_path) {
+    char old_name[MAX_FILENAME_LENGTH];
+    char new_name[MAX_FILENAME_LENGTH];
+
+    PSEUDO_INODE *old_parent = zos_resolve_parent(fs, old_path, old_name);
+    PSEUDO_INODE *new_parent = zos_resolve_parent(fs, new_path, new_name);
+    if (old_parent == NULL || new_parent == NULL) {
+        return false;
+    }
+
+    PSEUDO_INODE *inode = cache_lookup(fs, old_parent, old_name);
+    if (inode == NULL || inode->node_id == 0 || directory_lookup(fs, new_parent, new_name) != -1) {
+        return false;
+    }
+
+    // a directory can't be moved under itself
+    if (inode->isDirectory == true) {
+        for (PSEUDO_INODE *ancestor = new_parent; ; ancestor = &fs->inodes->data[ancestor->parent_id]) {
+            if (ancestor == inode) {
+                return false;
+            }
+            if (ancestor->node_id == 0) {
+                break;
+            }
+        }
+    }
+
+    if (directory_remove(fs, old_parent, old_name) == false) {
+        return false;
+    }
+    if (add_item_to_directory(fs, new_parent, new_name, inode) == false) {
+        add_item_to_directory(fs, old_parent, old_name, inode);
+        return false;
+    }
+
+    // a moved directory points to its new parent
+    if (inode->isDirectory == true && old_parent != new_parent) {
+        directory_remove(fs, inode, "..");
+        directory_insert(fs, inode, "..", new_parent->node_id);
+    }
+    zos_commit_if_full(fs);
+
+    return true;
+}
+
+/**
+ * Vypíše položky adresáře do pole, včetně '.' a '..'.
+ *
+ * @param fs - struktura file systému
+ * @param path - cesta k adresáři, NULL = aktuální adresář
+ * @param entries - pole pro položky
+ * @param capacity - velikost pole, vyplní se nejvýše tolik položek
+ *
+ * @return počet položek adresáře (může být větší než capacity), -1 = adresář neexistuje
+ */
+int32_t zos_readdir(FS *fs, const char *path, ZOS_DIRENT *entries, int32_t capacity) {
+    PSEUDO_INODE *dir = (path == NULL) ? fs->current_inode : zos_resolve(fs, path);
+    if (dir == NULL || dir->isDirectory == false) {
+        return -1;
+    }
+
+    // borrowed from the cache, must not be freed
+    DIRECTORY_ITEMS *items = cache_get_directory(fs, dir);
+    for (int32_t i = 0; i < items->size && i < capacity; i++) {
+        entries[i].node_id = items->data[i].node_id;
+        entries[i].is_directory = fs->inodes->data[items->data[i].node_id].isDirectory;
+        strncpy(entries[i].name, items->data[i].item_name, MAX_FILENAME_LENGTH - 1);
+        entries[i].name[MAX_FILENAME_LENGTH - 1] = '\0';
+    }
+
+    return items->size;
+}
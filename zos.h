@@ -0,0 +1,40 @@
+#ifndef ZOS_ZOS_H
+#define ZOS_ZOS_H
+
+#include "header.h"
+
+// polozka adresare vracena z zos_readdir
+typedef struct zos_dirent {
+    int32_t node_id;                    // id i-nodu polozky
+    bool is_directory;                  // polozka je adresar
+    char name[MAX_FILENAME_LENGTH];     // jmeno polozky
+} ZOS_DIRENT;
+
+// informace o i-nodu vracene z zos_stat
+typedef struct zos_stat {
+    int32_t node_id;                    // id i-nodu
+    int32_t parent_id;                  // id rodicovskeho adresare
+    bool is_directory;                  // i-node je adresar
+    bool is_slink;                      // i-node je symbolicky odkaz
+    int32_t linked_node_id;             // cil symbolickeho odkazu, jinak -1
+    int32_t count_clusters;             // pocet datovych clusteru
+    int64_t size;                       // velikost v bajtech
+} ZOS_STAT;
+
+FS *zos_open(const char *image);
+FS *zos_format(const char *image, int64_t disk_size, int32_t cluster_size, int32_t inode_count);
+void zos_sync(FS *fs);
+void zos_close(FS *fs);
+
+int32_t zos_lookup(FS *fs, const char *path);
+bool zos_stat(FS *fs, int32_t node_id, ZOS_STAT *stat);
+int64_t zos_read(FS *fs, int32_t node_id, void *buffer, int64_t offset, int64_t length);
+bool zos_write(FS *fs, const char *path, const void *buffer, int64_t length);
+int64_t zos_pwrite(FS *fs, int32_t node_id, const void *buffer, int64_t offset, int64_t length);
+int64_t zos_append(FS *fs, int32_t node_id, const void *buffer, int64_t length);
+bool zos_mkdir(FS *fs, const char *path);
+bool zos_unlink(FS *fs, const char *path);
+bool zos_rename(FS *fs, const char *old_path, const char *new_path);
+int32_t zos_readdir(FS *fs, const char *path, ZOS_DIRENT *entries, int32_t capacity);
+
+#endif //ZOS_ZOS_H
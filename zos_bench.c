@@ -0,0 +1,596 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "header.h"
+#include "zos.h"
+#include "fs.h"
+#include "inodes.h"
+#include "directory.h"
+#include "commands.h"
+#include "io.h"
+#include "arena.h"
+
+#define BENCH_OPS 200                               // default number of operations per case
+#define BENCH_BYTES_PER_CASE (256LL * 1024 * 1024)  // data written by one case at most
+#define BENCH_LOOKUPS 10000                         // lookups per case, they are much cheaper
+#define BENCH_DIRECTORY_ENTRIES 50000               // entries of the one big directory
+
+#ifdef ZOS_BENCH_WRAP_MALLOC
+// the linker redirects malloc, calloc and realloc of the library and the benchmark here (-Wl,--wrap)
+static uint64_t n_of_allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    n_of_allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    n_of_allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    n_of_allocations++;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+// merene operace jednoho pripadu
+typedef struct bench_case {
+    const char *operation;      // jmeno operace
+    int64_t file_size;          // velikost souboru, 0 = bez dat
+    int32_t fanout;             // pocet polozek adresare, ve kterem operace pracuje
+    int32_t depth;              // pocet adresaru na ceste
+    int32_t ops;                // pocet zmerenych operaci
+    int64_t *latencies;         // doba kazde operace v ns
+    int64_t total_ns;           // doba vsech operaci
+    uint64_t allocations;       // pocet alokaci vsech operaci
+} BENCH_CASE;
+
+static FILE *json = NULL;       // results, stdout of the shell handlers goes to /dev/null
+static bool first_result = true;
+static char image[PATH_MAX];
+static char out_dir[PATH_MAX];
+
+/**
+ * Vrátí monotónní čas v nanosekundách.
+ *
+ * @return čas v ns
+ */
+static int64_t now_ns(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t) time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+/**
+ * Vrátí dosavadní počet alokací.
+ *
+ * @return počet alokací, 0 - alokace se nepočítají
+ */
+static uint64_t allocations(void) {
+#ifdef ZOS_BENCH_WRAP_MALLOC
+    return n_of_allocations;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Připraví případ pro zadaný počet operací.
+ *
+ * @param bench - připravovaný případ
+ * @param operation - jméno operace
+ * @param file_size - velikost souborů
+ * @param fanout - počet položek adresáře
+ * @param depth - počet adresářů na cestě
+ * @param ops - nejvyšší počet operací
+ */
+static void case_init(BENCH_CASE *bench, const char *operation, int64_t file_size, int32_t fanout, int32_t depth,
+                      int32_t ops) {
+    memset(bench, 0, sizeof(BENCH_CASE));
+    bench->operation = operation;
+    bench->file_size = file_size;
+    bench->fanout = fanout;
+    bench->depth = depth;
+    bench->latencies = calloc(ops, sizeof(int64_t));
+}
+
+/**
+ * Začne měření jedné operace.
+ *
+ * @param allocs - výstup, počet alokací na začátku operace
+ *
+ * @return čas začátku v ns
+ */
+static int64_t op_begin(uint64_t *allocs) {
+    *allocs = allocations();
+    return now_ns();
+}
+
+/**
+ * Ukončí měření operace a zaznamená její dobu a alokace.
+ *
+ * @param bench - případ
+ * @param start - čas začátku z op_begin
+ * @param allocs - počet alokací z op_begin
+ */
+static void op_end(BENCH_CASE *bench, int64_t start, uint64_t allocs) {
+    int64_t latency = now_ns() - start;
+    bench->allocations += allocations() - allocs;
+    bench->latencies[bench->ops++] = latency;
+    bench->total_ns += latency;
+}
+
+/**
+ * Porovná dvě doby operací pro qsort.
+ */
+static int compare_latency(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Vrátí percentil doby operací. Doby musí být seřazené.
+ *
+ * @param bench - případ
+ * @param percentile - percentil 0..1
+ *
+ * @return doba v us
+ */
+static double percentile_us(BENCH_CASE *bench, double percentile) {
+    return bench->latencies[(int32_t) ((bench->ops - 1) * percentile)] / 1000.0;
+}
+
+/**
+ * Zapíše případ jako jeden JSON objekt výsledků a uvolní ho.
+ *
+ * @param bench - případ
+ */
+static void case_report(BENCH_CASE *bench) {
+    if (bench->ops == 0) {
+        free(bench->latencies);
+        return;
+    }
+
+    qsort(bench->latencies, bench->ops, sizeof(int64_t), compare_latency);
+    double seconds = bench->total_ns / 1e9;
+
+    fprintf(json, "%s    {\"operation\": \"%s\", \"file_size\": %lld, \"fanout\": %d, \"depth\": %d, \"ops\": %d, ",
+            first_result ? "" : ",\n", bench->operation, (long long) bench->file_size, bench->fanout, bench->depth,
+            bench->ops);
+    fprintf(json, "\"ops_per_sec\": %.1f, ", bench->ops / seconds);
+    if (bench->file_size > 0) {
+        fprintf(json, "\"mb_per_sec\": %.2f, ", bench->file_size * (double) bench->ops / (1024 * 1024) / seconds);
+    } else {
+        fprintf(json, "\"mb_per_sec\": null, ");
+    }
+    fprintf(json, "\"p50_us\": %.2f, \"p99_us\": %.2f, ", percentile_us(bench, 0.50), percentile_us(bench, 0.99));
+#ifdef ZOS_BENCH_WRAP_MALLOC
+    fprintf(json, "\"allocs_per_op\": %.2f}", (double) bench->allocations / bench->ops);
+#else
+    fprintf(json, "\"allocs_per_op\": null}");
+#endif
+    fflush(json);
+
+    first_result = false;
+    free(bench->latencies);
+}
+
+/**
+ * Naformátuje nový dočasný obraz dost velký pro případ.
+ *
+ * @param data_size - velikost dat případu
+ * @param inode_count - počet i-nodů, 0 - podle velikosti disku
+ *
+ * @return struktura file systému, NULL - obraz nelze vytvořit
+ */
+static FS *bench_format(int64_t data_size, int32_t inode_count) {
+    int64_t disk_size = data_size + data_size / 4 + 64LL * 1024 * 1024;
+    return zos_format(image, disk_size, 0, inode_count);
+}
+
+/**
+ * Spustí obsluhu příkazu shellu stejně jako commands() - první token je jméno příkazu, dočasná
+ * data obsluhy se po jejím skončení uvolní z areny.
+ *
+ * @param fs - struktura file systému
+ * @param handler - obsluha příkazu
+ * @param format - formát příkazu se dvěma argumenty
+ * @param a - první argument
+ * @param b - druhý argument
+ *
+ * @return  true - příkaz uspěl
+ *          false - jinak
+ */
+static bool run_handler(FS *fs, bool (*handler)(FS *, char *), const char *format, const char *a, const char *b) {
+    char command[MAX_COMMAND_LENGTH];
+    if (snprintf(command, sizeof(command), format, a, b) >= (int) sizeof(command)) {
+        return false;
+    }
+    char *token = strtok(command, SPLIT_ARGS_CHAR);
+    ARENA_MARK mark = arena_mark();
+    bool result = handler(fs, token);
+    arena_release(mark);
+    return result;
+}
+
+/**
+ * Obsluha příkazu rm (soubor) ve tvaru pro run_handler.
+ */
+static bool rm_handler(FS *fs, char *token) {
+    return remove_file_or_directory(fs, token, false);
+}
+
+/**
+ * Vytvoří buffer s obsahem souborů benchmarku.
+ *
+ * @param file_size - velikost souboru
+ *
+ * @return buffer, uvolní ho volající
+ */
+static char *bench_data(int64_t file_size) {
+    char *data = malloc(file_size);
+    for (int64_t i = 0; i < file_size; i++) {
+        data[i] = (char) ('a' + i % 26);
+    }
+    return data;
+}
+
+/**
+ * incp (create_file_in_FS) souborů jedné velikosti do jednoho adresáře, potom rm všech z nich.
+ *
+ * @param file_size - velikost souborů
+ * @param ops - počet souborů, omezený BENCH_BYTES_PER_CASE
+ */
+static void bench_create_remove(int64_t file_size, int32_t ops) {
+    if (ops > BENCH_BYTES_PER_CASE / file_size) {
+        ops = (int32_t) (BENCH_BYTES_PER_CASE / file_size);
+    }
+    FS *fs = bench_format(file_size * ops, 0);
+    if (fs == NULL) {
+        return;
+    }
+    char *data = bench_data(file_size);
+    PSEUDO_INODE *root = &fs->inodes->data[0];
+
+    BENCH_CASE create;
+    case_init(&create, "create", file_size, ops, 1, ops);
+    for (int32_t i = 0; i < ops; i++) {
+        char name[MAX_FILENAME_LENGTH];
+        snprintf(name, sizeof(name), "f%06d", i);
+        FILE *source = fmemopen(data, file_size, "r");
+
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        bool result = create_file_in_FS(fs, source, name, root);
+        io_flush(fs);
+        op_end(&create, start, allocs);
+        if (result == false) {
+            break;
+        }
+    }
+    int32_t created = create.ops;
+    case_report(&create);
+
+    BENCH_CASE remove;
+    case_init(&remove, "remove", file_size, created, 1, created);
+    for (int32_t i = 0; i < created; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "/f%06d", i);
+
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        run_handler(fs, rm_handler, "rm %s%s", path, "");
+        io_flush(fs);
+        op_end(&remove, start, allocs);
+    }
+    case_report(&remove);
+
+    free(data);
+    zos_close(fs);
+}
+
+/**
+ * Ověří, že se jméno o MAX_FILENAME_LENGTH znacích odmítne a nejdelší povolené jméno se dá
+ * najít i smazat. Oříznuté jméno by se uložilo, ale už nenašlo.
+ *
+ * @return  true - jména fungují
+ *          false - jinak
+ */
+static bool check_filenames(void) {
+    FS *fs = bench_format(0, 0);
+    if (fs == NULL) {
+        return false;
+    }
+    PSEUDO_INODE *root = &fs->inodes->data[0];
+    char data[] = "hello";
+
+    bool result = create_file_in_FS(fs, fmemopen(data, sizeof(data), "r"), "document.txt", root) == false;
+    result = result && create_file_in_FS(fs, fmemopen(data, sizeof(data), "r"), "document.tx", root) == true;
+    result = result && directory_lookup(fs, root, "document.tx") != -1;
+    result = result && create_file_in_FS(fs, fmemopen(data, sizeof(data), "r"), "document.tx", root) == false;
+    result = result && run_handler(fs, rm_handler, "rm %s%s", "/document.tx", "") == true;
+    result = result && directory_lookup(fs, root, "document.tx") == -1;
+
+    zos_close(fs);
+    return result;
+}
+
+/**
+ * search_for_inode náhodných souborů na konci řetězce adresářů.
+ *
+ * @param depth - počet adresářů na cestě
+ * @param fanout - počet souborů v posledním adresáři
+ */
+static void bench_lookup(int32_t depth, int32_t fanout) {
+    FS *fs = bench_format(0, fanout + depth + INODES_MIN_COUNT);
+    if (fs == NULL) {
+        return;
+    }
+
+    char path[PATH_MAX] = "";
+    for (int32_t i = 0; i < depth; i++) {
+        size_t length = strlen(path);
+        snprintf(path + length, sizeof(path) - length, "/d%05d", i);
+        zos_mkdir(fs, path);
+    }
+    for (int32_t i = 0; i < fanout; i++) {
+        char file[PATH_MAX];
+        if (snprintf(file, sizeof(file), "%s/f%06d", path, i) < (int) sizeof(file)) {
+            zos_write(fs, file, "", 0);
+        }
+    }
+    zos_sync(fs);
+
+    BENCH_CASE lookup;
+    case_init(&lookup, "lookup", 0, fanout, depth, BENCH_LOOKUPS);
+    PSEUDO_INODE *root = &fs->inodes->data[0];
+    srand(depth * 7919 + fanout);
+    for (int32_t i = 0; i < BENCH_LOOKUPS; i++) {
+        char file[PATH_MAX];
+        if (snprintf(file, sizeof(file), "%s/f%06d", path, rand() % fanout) >= (int) sizeof(file)) {
+            break;
+        }
+
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        PSEUDO_INODE *inode = search_for_inode(fs, root, file, false);
+        op_end(&lookup, start, allocs);
+        if (inode == NULL) {
+            fprintf(stderr, "LOOKUP OF %s FAILED\n", file);
+            break;
+        }
+    }
+    case_report(&lookup);
+
+    zos_close(fs);
+}
+
+/**
+ * Vytvoření, hledání a smazání velkého počtu prázdných souborů v jednom adresáři. Tabulka adresáře
+ * při tom roste přes nepřímé odkazy.
+ *
+ * @param entries - počet souborů
+ */
+static void bench_directory(int32_t entries) {
+    FS *fs = bench_format((int64_t) entries * CLUSTER_SIZE, entries + INODES_MIN_COUNT);
+    if (fs == NULL) {
+        return;
+    }
+    PSEUDO_INODE *root = &fs->inodes->data[0];
+
+    BENCH_CASE create;
+    case_init(&create, "create", 0, entries, 1, entries);
+    for (int32_t i = 0; i < entries; i++) {
+        char file[PATH_MAX];
+        snprintf(file, sizeof(file), "/f%06d", i);
+
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        bool result = zos_write(fs, file, "", 0);
+        op_end(&create, start, allocs);
+        if (result == false) {
+            fprintf(stderr, "CREATE OF %s FAILED\n", file);
+            break;
+        }
+    }
+    int32_t created = create.ops;
+    case_report(&create);
+    zos_sync(fs);
+
+    BENCH_CASE lookup;
+    case_init(&lookup, "lookup", 0, created, 1, BENCH_LOOKUPS);
+    srand(entries);
+    for (int32_t i = 0; i < BENCH_LOOKUPS && created > 0; i++) {
+        char file[PATH_MAX];
+        snprintf(file, sizeof(file), "/f%06d", rand() % created);
+
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        PSEUDO_INODE *inode = search_for_inode(fs, root, file, false);
+        op_end(&lookup, start, allocs);
+        if (inode == NULL) {
+            fprintf(stderr, "LOOKUP OF %s FAILED\n", file);
+            break;
+        }
+    }
+    case_report(&lookup);
+
+    BENCH_CASE remove;
+    case_init(&remove, "remove", 0, created, 1, created);
+    for (int32_t i = 0; i < created; i++) {
+        char file[PATH_MAX];
+        snprintf(file, sizeof(file), "/f%06d", i);
+
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        bool result = zos_unlink(fs, file);
+        op_end(&remove, start, allocs);
+        if (result == false) {
+            fprintf(stderr, "REMOVE OF %s FAILED\n", file);
+            break;
+        }
+    }
+    case_report(&remove);
+
+    zos_close(fs);
+}
+
+/**
+ * cp (copy_file) jednoho souboru do samostatných adresářů a outcp (file_out) souboru.
+ *
+ * @param file_size - velikost souboru
+ * @param ops - počet kopií, outcp je omezený BENCH_BYTES_PER_CASE
+ */
+static void bench_copy_out(int64_t file_size, int32_t ops) {
+    int32_t out_ops = ops;
+    if (out_ops > BENCH_BYTES_PER_CASE / file_size) {
+        out_ops = (int32_t) (BENCH_BYTES_PER_CASE / file_size);
+    }
+    // a directory and a copy per operation
+    FS *fs = bench_format(file_size, 2 * ops + INODES_MIN_COUNT);
+    if (fs == NULL) {
+        return;
+    }
+    char *data = bench_data(file_size);
+    zos_write(fs, "/source", data, file_size);
+    for (int32_t i = 0; i < ops; i++) {
+        char name[PATH_MAX];
+        snprintf(name, sizeof(name), "/c%05d", i);
+        zos_mkdir(fs, name);
+    }
+    zos_sync(fs);
+
+    BENCH_CASE copy;
+    case_init(&copy, "copy", file_size, ops, 1, ops);
+    for (int32_t i = 0; i < ops; i++) {
+        char name[PATH_MAX];
+        snprintf(name, sizeof(name), "/c%05d", i);
+
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        bool result = run_handler(fs, copy_file, "cp %s %s", "/source", name);
+        io_flush(fs);
+        op_end(&copy, start, allocs);
+        if (result == false) {
+            break;
+        }
+    }
+    case_report(&copy);
+
+    BENCH_CASE out;
+    case_init(&out, "outcp", file_size, ops, 1, out_ops);
+    for (int32_t i = 0; i < out_ops; i++) {
+        uint64_t allocs;
+        int64_t start = op_begin(&allocs);
+        bool result = run_handler(fs, file_out, "outcp %s %s", "/source", out_dir);
+        io_flush(fs);
+        op_end(&out, start, allocs);
+        if (result == false) {
+            break;
+        }
+    }
+    case_report(&out);
+
+    free(data);
+    zos_close(fs);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    const char *directory = NULL;
+    int32_t ops = BENCH_OPS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            ops = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n ops] [-d work directory] [-o results.json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // temporary images and outcp files
+    char work_dir[PATH_MAX];
+    if (directory == NULL) {
+        strcpy(work_dir, "/tmp/zos_bench.XXXXXX");
+        if (mkdtemp(work_dir) == NULL) {
+            perror("mkdtemp");
+            return EXIT_FAILURE;
+        }
+    } else {
+        snprintf(work_dir, sizeof(work_dir), "%s", directory);
+    }
+    if (snprintf(image, sizeof(image), "%s/bench.img", work_dir) >= (int) sizeof(image)) {
+        fprintf(stderr, "Work directory %s is too long\n", work_dir);
+        return EXIT_FAILURE;
+    }
+    snprintf(out_dir, sizeof(out_dir), "%s", work_dir);
+
+    // the handlers print to stdout, the results go to the original one or to the file
+    if (output != NULL) {
+        json = fopen(output, "w");
+    } else {
+        json = fdopen(dup(STDOUT_FILENO), "w");
+    }
+    if (json == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("output");
+        return EXIT_FAILURE;
+    }
+
+    if (check_filenames() == false) {
+        fprintf(stderr, "FILENAME CHECK FAILED\n");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(json, "{\n  \"benchmark\": \"zos_bench\",\n  \"cluster_size\": %d,\n  \"results\": [\n", CLUSTER_SIZE);
+
+    int64_t sizes[] = {4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_create_remove(sizes[i], ops);
+    }
+
+    int32_t depths[] = {1, 4, 16};
+    int32_t fanouts[] = {10, 100, 1000};
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        for (size_t j = 0; j < sizeof(fanouts) / sizeof(fanouts[0]); j++) {
+            bench_lookup(depths[i], fanouts[j]);
+        }
+    }
+
+    bench_directory(BENCH_DIRECTORY_ENTRIES);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_copy_out(sizes[i], ops);
+    }
+
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+
+    // the work directory is left only when it was given
+    char out_file[PATH_MAX];
+    if (snprintf(out_file, sizeof(out_file), "%s/source", work_dir) < (int) sizeof(out_file)) {
+        unlink(out_file);
+    }
+    unlink(image);
+    if (directory == NULL) {
+        rmdir(work_dir);
+    }
+
+    arena_free();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "header.h"
+#include "fs.h"
+#include "commands.h"
+#include "io.h"
+#include "stats.h"
+#include "trace.h"
+#include "arena.h"
+
+// doby jednoho prikazu zaznamu
+typedef struct replay_command {
+    char name[STATS_NAME_LENGTH];   // jmeno prikazu, musi byt prvni (stats_find_entry)
+    int64_t *latencies;             // doba kazdeho volani v ns
+    int32_t count;                  // pocet volani
+    int32_t capacity;               // velikost latencies
+    int32_t failures;               // pocet neuspesnych volani
+} REPLAY_COMMAND;
+
+static REPLAY_COMMAND replayed[STATS_MAX_COMMANDS];
+static int32_t n_of_replayed = 0;
+
+/**
+ * Zkopíruje obraz, díry zůstanou dírami, takže se řídký obraz zkopíruje rychle.
+ *
+ * @param source - zdrojový obraz
+ * @param destination - kopie, existující soubor se přepíše
+ *
+ * @return  true - obraz je zkopírovaný
+ *          false - chyba čtení nebo zápisu
+ */
+static bool copy_image(const char *source, const char *destination) {
+    int in = open(source, O_RDONLY);
+    if (in == -1) {
+        return false;
+    }
+    int out = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out == -1) {
+        close(in);
+        return false;
+    }
+
+    char *buffer = malloc(IO_CHUNK_SIZE);
+    bool result = buffer != NULL;
+    off_t size = 0;
+    ssize_t length;
+    while (result == true && (length = read(in, buffer, IO_CHUNK_SIZE)) > 0) {
+        // zeros are skipped, the final ftruncate sets the size
+        if (buffer[0] != 0 || memcmp(buffer, buffer + 1, length - 1) != 0) {
+            result = pwrite(out, buffer, length, size) == length;
+        }
+        size += length;
+    }
+    if (result == true && ftruncate(out, size) != 0) {
+        result = false;
+    }
+
+    free(buffer);
+    close(in);
+    if (close(out) != 0) {
+        result = false;
+    }
+    return result;
+}
+
+/**
+ * Počká do zadaného monotónního času, přehrání tak dodrží tempo záznamu.
+ *
+ * @param deadline_ns - čas v ns
+ */
+static void sleep_until(int64_t deadline_ns) {
+    int64_t now = stats_now();
+    if (deadline_ns <= now) {
+        return;
+    }
+
+    struct timespec delay;
+    delay.tv_sec = (deadline_ns - now) / 1000000000LL;
+    delay.tv_nsec = (deadline_ns - now) % 1000000000LL;
+    nanosleep(&delay, NULL);
+}
+
+/**
+ * Zaznamená jeden přehraný příkaz. Příkazy se dělí podle jmen stejně jako ve statistikách.
+ *
+ * @param command - jméno příkazu
+ * @param result - výsledek příkazu
+ * @param latency - doba příkazu v ns
+ */
+static void record(const char *command, bool result, int64_t latency) {
+    char name[STATS_NAME_LENGTH];
+    stats_command_name(command, name);
+    REPLAY_COMMAND *entry = stats_find_entry(replayed, sizeof(REPLAY_COMMAND), &n_of_replayed, name);
+
+    if (entry->count == entry->capacity) {
+        entry->capacity = entry->capacity == 0 ? 64 : entry->capacity * 2;
+        entry->latencies = realloc(entry->latencies, entry->capacity * sizeof(int64_t));
+    }
+    entry->latencies[entry->count++] = latency;
+    if (result == false) {
+        entry->failures++;
+    }
+}
+
+/**
+ * Porovná dvě doby příkazů pro qsort.
+ */
+static int compare_latency(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Zapíše propustnost a doby všech příkazů jako JSON.
+ *
+ * @param json - výstupní soubor
+ * @param trace - soubor záznamu
+ * @param paced - přehrávalo se v tempu záznamu
+ * @param n_of_commands - počet přehraných příkazů
+ * @param failures - počet neúspěšných příkazů
+ * @param wall_ns - doba celého přehrání v ns
+ */
+static void report(FILE *json, const char *trace, bool paced, int32_t n_of_commands, int32_t failures,
+                   int64_t wall_ns) {
+    double seconds = wall_ns / 1e9;
+
+    fprintf(json, "{\n  \"trace\": ");
+    print_json_string(json, trace);
+    fprintf(json, ",\n  \"paced\": %s,\n  \"commands\": %d,\n  \"failures\": %d,\n",
+            paced ? "true" : "false", n_of_commands, failures);
+    fprintf(json, "  \"wall_seconds\": %.6f,\n  \"commands_per_sec\": %.1f,\n  \"per_command\": [",
+            seconds, seconds > 0 ? n_of_commands / seconds : 0.0);
+
+    bool first = true;
+    for (int32_t i = 0; i < STATS_MAX_COMMANDS; i++) {
+        REPLAY_COMMAND *entry = &replayed[i];
+        if (entry->count == 0) {
+            continue;
+        }
+        qsort(entry->latencies, entry->count, sizeof(int64_t), compare_latency);
+
+        int64_t total = 0;
+        for (int32_t j = 0; j < entry->count; j++) {
+            total += entry->latencies[j];
+        }
+        fprintf(json, "%s\n    {\"command\": \"%s\", \"calls\": %d, \"failures\": %d, \"mean_us\": %.2f, "
+                      "\"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}",
+                first ? "" : ",", entry->name, entry->count, entry->failures, total / 1000.0 / entry->count,
+                entry->latencies[(entry->count - 1) / 2] / 1000.0,
+                entry->latencies[(int32_t) ((entry->count - 1) * 0.99)] / 1000.0,
+                entry->latencies[entry->count - 1] / 1000.0);
+        free(entry->latencies);
+        first = false;
+    }
+
+    fprintf(json, "\n  ],\n  \"stats\": ");
+    print_stats_json(json);
+    fprintf(json, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    const char *copy = NULL;
+    const char *trace = NULL;
+    const char *image = NULL;
+    bool paced = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0) {
+            paced = true;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            copy = argv[++i];
+        } else if (argv[i][0] != '-' && trace == NULL) {
+            trace = argv[i];
+        } else if (argv[i][0] != '-' && image == NULL) {
+            image = argv[i];
+        } else {
+            trace = NULL;
+            break;
+        }
+    }
+    if (trace == NULL || image == NULL) {
+        fprintf(stderr, "Usage: %s [-p] [-w copy.img] [-o results.json] trace.txt image\n", argv[0]);
+        fprintf(stderr, "  -p  keep the recorded pacing, otherwise the commands run at full speed\n");
+        return 2;
+    }
+
+    // the recorded image itself is never changed
+    char copy_name[FS_FILENAME_LENGTH];
+    snprintf(copy_name, sizeof(copy_name), "%s", copy != NULL ? copy : image);
+    if (copy == NULL) {
+        strncat(copy_name, ".replay", sizeof(copy_name) - strlen(copy_name) - 1);
+    }
+    struct stat source_stat;
+    struct stat copy_stat;
+    if (stat(image, &source_stat) == 0 && stat(copy_name, &copy_stat) == 0 &&
+        source_stat.st_dev == copy_stat.st_dev && source_stat.st_ino == copy_stat.st_ino) {
+        fprintf(stderr, "The copy %s is the recorded image itself\n", copy_name);
+        return EXIT_FAILURE;
+    }
+    if (copy_image(image, copy_name) == false) {
+        fprintf(stderr, "Cannot copy %s to %s\n", image, copy_name);
+        return EXIT_FAILURE;
+    }
+
+    FILE *input = fopen(trace, "r");
+    if (input == NULL) {
+        fprintf(stderr, "Cannot open trace %s\n", trace);
+        return EXIT_FAILURE;
+    }
+
+    // the commands print to stdout, the results go to the original one or to the file
+    FILE *json = output != NULL ? fopen(output, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (json == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("output");
+        return EXIT_FAILURE;
+    }
+
+    isInteractive = 0;
+    FS *fs = fs_init(copy_name, SIGNATURE, DESCRIPTOR, DISK_SIZE, CLUSTER_SIZE, 0, 1);
+    if (fs == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    char line[MAX_COMMAND_LENGTH];
+    int32_t n_of_commands = 0;
+    int32_t failures = 0;
+    int64_t replay_start = stats_now();
+    while (isRunning && fgets(line, sizeof(line), input) != NULL) {
+        int64_t time_us;
+        char *command;
+        if (trace_parse_line(line, &time_us, &command) == false) {
+            continue;
+        }
+        if (paced == true) {
+            sleep_until(replay_start + time_us * 1000);
+        }
+
+        char *token = strtok(command, SPLIT_ARGS_CHAR);
+        if (token == NULL) {
+            continue;
+        }
+        char name[STATS_NAME_LENGTH];
+        snprintf(name, sizeof(name), "%s", token);
+
+        // like the shell - the command and the flush at its boundary
+        int64_t start = stats_now();
+        bool result = commands(fs, token);
+        io_flush(fs);
+        record(name, result, stats_now() - start);
+
+        n_of_commands++;
+        if (result == false) {
+            failures++;
+        }
+    }
+    int64_t wall_ns = stats_now() - replay_start;
+    fclose(input);
+
+    io_close(fs);
+    free(fs);
+    arena_free();
+
+    report(json, trace, paced, n_of_commands, failures, wall_ns);
+    fclose(json);
+
+    return EXIT_SUCCESS;
+}